@@ -0,0 +1,533 @@
+/*
+* Copyright (c) 2012 Alexander Korsunsky <fat.lobyte9@gmail.com>
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+* 1. Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+* IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+* THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+* PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+* OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+* OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef ARENA_ALLOCATOR_HPP_INCLUDED
+#define ARENA_ALLOCATOR_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <atomic>
+#include <mutex>
+
+#if defined(__unix__) || defined(__APPLE__)
+#   include <sys/mman.h>
+#   define AQ_ARENA_USE_MMAP
+#endif
+
+#include "atomic_queue.hpp"
+
+namespace aq {
+
+namespace detail {
+
+/** Memory that is carved from large chunks and given back all at once.
+*
+* Chunks are mapped with huge pages where possible: first with MAP_HUGETLB,
+* then as regular pages with madvise(MADV_HUGEPAGE), so that transparent huge
+* pages can back them. On systems without mmap(), chunks come from
+* ::operator new. Every chunk is aligned to its size, which is a power of
+* two, so the chunk a block belongs to can be found from the block's address.
+*
+* Blocks of up to max_block_size bytes are sorted into size classes of
+* 16 bytes each. Freed blocks are kept on a lock-free free list per class and
+* handed out again by the next allocation of that class. Because chunks stay
+* mapped until the arena is destroyed, popping from a free list never touches
+* unmapped memory. Like the links of compact_queue, the list heads hold a
+* 32 bit block index and a 32 bit tag that changes on every update, which
+* guards against the ABA problem. Larger blocks are passed on to
+* ::operator new.
+*/
+class arena
+{
+public:
+
+    /** Size of a huge page, and the smallest chunk size. */
+    static const std::size_t huge_page_size = std::size_t(2) << 20;
+
+    /** Largest chunk size. */
+    static const std::size_t max_chunk_size = std::size_t(1) << 30;
+
+    /** Largest number of chunks in an arena. */
+    static const std::size_t max_chunk_count = 4096;
+
+    /** Largest block that is taken from the chunks. */
+    static const std::size_t max_block_size = 512;
+
+    /** Alignment of the blocks taken from the chunks. */
+    static const std::size_t block_alignment = 16;
+
+    /** Construct an empty arena.
+    *
+    * No chunk is mapped until the first allocation.
+    *
+    * @param chunk_size Size of the chunks, rounded up to a power of two
+    * between huge_page_size and max_chunk_size. If zero, huge_page_size is
+    * used.
+    * @throws std::bad_alloc
+    */
+    explicit arena(std::size_t chunk_size = 0)
+        : chunk_size_(round_chunk_size(chunk_size)), chunk_shift_(0),
+        chunk_limit_(0), chunk_count_(0), cursor_(nullptr), end_(nullptr),
+        reserved_(0u)
+    {
+        while ((block_alignment << chunk_shift_) < chunk_size_)
+            ++chunk_shift_;
+
+        // block indices are 32 bits: chunk number and block within the chunk
+        chunk_limit_ = std::size_t(1) << (32 - chunk_shift_);
+        if (chunk_limit_ > max_chunk_count)
+            chunk_limit_ = max_chunk_count;
+        chunks_.reset(new chunk*[chunk_limit_]);
+
+        for (std::size_t i = 0; i < class_count; ++i)
+            free_[i].head.store(pack(NIL, 0u), std::memory_order_relaxed);
+    }
+
+    /** Destructor. Releases all chunks, regardless of blocks still in use. */
+    ~arena() noexcept
+    {
+        for (std::size_t i = 0; i < chunk_count_; ++i)
+            release_chunk(chunks_[i]);
+    }
+
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+
+    /** Allocate a block of memory.
+    *
+    * @param bytes Size of the block.
+    * @return Pointer to the block, aligned to block_alignment if it is taken
+    * from a chunk.
+    * @throws std::bad_alloc, also if the arena has max_chunk_count chunks
+    * and needs another one.
+    *
+    * @note This function is Thread-safe. It is lock-free unless the free list
+    * of the size class is empty.
+    */
+    void* allocate(std::size_t bytes)
+    {
+        if (bytes > max_block_size)
+            return ::operator new(bytes);
+
+        const std::size_t cls = class_of(bytes);
+        if (free_block* b = pop(cls))
+            return b;
+        return refill(cls);
+    }
+
+    /** Deallocate a block of memory.
+    *
+    * @param p Pointer returned by allocate().
+    * @param bytes Size that was passed to allocate().
+    *
+    * @note This function is Thread-safe and lock-free.
+    */
+    void deallocate(void* p, std::size_t bytes) noexcept
+    {
+        if (bytes > max_block_size)
+            return ::operator delete(p);
+
+        free_block* b = ::new(p) free_block;
+        push(class_of(bytes), b, b);
+    }
+
+    /** Get the number of bytes reserved in chunks.
+    *
+    * @note This function is Thread-safe, lock-free and wait-free.
+    */
+    std::size_t reserved() const noexcept
+    { return reserved_; }
+
+private:
+
+    static const std::size_t class_count = max_block_size / block_alignment;
+
+    // Blocks are carved in batches of about this many bytes
+    static const std::size_t batch_bytes = 4096;
+
+    typedef std::uint32_t index_type;
+
+    // Index 0 is the header of the first chunk, never a block
+    static const index_type NIL = 0;
+
+    // Header at the start of each chunk
+    struct chunk
+    {
+        std::size_t number /**< Position in chunks_. */;
+        void* raw /**< Memory to free, if not mapped. */;
+    };
+
+    static const std::size_t header_size =
+        (sizeof(chunk) + block_alignment - 1) / block_alignment *
+        block_alignment;
+
+    // A block on a free list
+    struct free_block
+    {
+        std::atomic<index_type> next;
+    };
+
+    struct free_list
+    {
+        std::atomic<std::uint64_t> head;
+        char pad[64 - sizeof(std::atomic<std::uint64_t>)];
+    };
+
+    static std::uint64_t pack(index_type index, std::uint32_t tag) noexcept
+    {
+        return (std::uint64_t(tag) << 32) | index;
+    }
+
+    static index_type index_of(std::uint64_t v) noexcept
+    {
+        return static_cast<index_type>(v);
+    }
+
+    static std::uint32_t tag_of(std::uint64_t v) noexcept
+    {
+        return static_cast<std::uint32_t>(v >> 32);
+    }
+
+    static std::size_t round_chunk_size(std::size_t n) noexcept
+    {
+        if (n > max_chunk_size)
+            n = max_chunk_size;
+
+        std::size_t size = huge_page_size;
+        while (size < n)
+            size <<= 1;
+        return size;
+    }
+
+    static std::size_t class_of(std::size_t bytes) noexcept
+    {
+        return bytes ? (bytes - 1) / block_alignment : 0;
+    }
+
+    index_type index_of_block(const void* b) const noexcept
+    {
+        const std::uintptr_t addr = reinterpret_cast<std::uintptr_t>(b);
+        const std::uintptr_t base = addr & ~std::uintptr_t(chunk_size_ - 1);
+
+        return static_cast<index_type>(
+            (reinterpret_cast<const chunk*>(base)->number << chunk_shift_) |
+            ((addr - base) / block_alignment)
+        );
+    }
+
+    free_block* block_at(index_type index) const noexcept
+    {
+        const std::size_t offset =
+            (index & ((std::size_t(1) << chunk_shift_) - 1)) * block_alignment;
+        return reinterpret_cast<free_block*>(
+            reinterpret_cast<char*>(chunks_[index >> chunk_shift_]) + offset
+        );
+    }
+
+    free_block* pop(std::size_t cls) noexcept
+    {
+        std::atomic<std::uint64_t>& head = free_[cls].head;
+        std::uint64_t old_head = head.load(std::memory_order_acquire);
+
+        for (;;)
+        {
+            if (index_of(old_head) == NIL)
+                return nullptr;
+
+            // The block may already be popped and in use by another thread.
+            // The read is harmless since the memory stays mapped, and the tag
+            // makes the exchange fail in that case.
+            free_block* b = block_at(index_of(old_head));
+            index_type next = b->next.load(std::memory_order_relaxed);
+            if (head.compare_exchange_weak(
+                    old_head, pack(next, tag_of(old_head) + 1),
+                    std::memory_order_acquire, std::memory_order_acquire))
+                return b;
+        }
+    }
+
+    // Push the already linked blocks first to last onto a free list
+    void push(std::size_t cls, free_block* first, free_block* last) noexcept
+    {
+        std::atomic<std::uint64_t>& head = free_[cls].head;
+        const index_type first_index = index_of_block(first);
+        std::uint64_t old_head = head.load(std::memory_order_relaxed);
+
+        do
+            last->next.store(index_of(old_head), std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(
+                    old_head, pack(first_index, tag_of(old_head) + 1),
+                    std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // Carve a batch of blocks from the current chunk. One is returned, the
+    // others go to the free list.
+    void* refill(std::size_t cls)
+    {
+        const std::size_t block_size = (cls + 1) * block_alignment;
+        std::size_t count = batch_bytes / block_size;
+
+        char* first;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (std::size_t(end_ - cursor_) < block_size)
+                add_chunk();
+
+            if (count > std::size_t(end_ - cursor_) / block_size)
+                count = std::size_t(end_ - cursor_) / block_size;
+
+            first = cursor_;
+            cursor_ += count * block_size;
+        }
+
+        if (count > 1)
+        {
+            // all blocks of the batch lie in the same chunk, one after another
+            const index_type second_index =
+                index_of_block(first + block_size);
+            free_block* const second = ::new(first + block_size) free_block;
+            free_block* last = second;
+
+            for (std::size_t i = 2; i < count; ++i)
+            {
+                free_block* b = ::new(first + i * block_size) free_block;
+                last->next.store(static_cast<index_type>(
+                    second_index + (i - 1) * (block_size / block_alignment)
+                ), std::memory_order_relaxed);
+                last = b;
+            }
+
+            push(cls, second, last);
+        }
+
+        return first;
+    }
+
+    // Map a new chunk and make it current. Called with mutex_ held.
+    void add_chunk()
+    {
+        if (chunk_count_ == chunk_limit_)
+            throw std::bad_alloc();
+
+        chunk* c = map_chunk(chunk_size_);
+        c->number = chunk_count_;
+
+        // Blocks of the new chunk only become visible to other threads
+        // through the release of a free list push, after this store.
+        chunks_[chunk_count_++] = c;
+
+        cursor_ = reinterpret_cast<char*>(c) + header_size;
+        end_ = reinterpret_cast<char*>(c) + chunk_size_;
+        reserved_ += chunk_size_;
+    }
+
+#ifdef AQ_ARENA_USE_MMAP
+    // Map size bytes aligned to size, or return null
+    static void* map_aligned(std::size_t size, int flags) noexcept
+    {
+        void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (p == MAP_FAILED)
+            return nullptr;
+        if (reinterpret_cast<std::uintptr_t>(p) % size == 0)
+            return p;
+
+        // Map twice the size and cut off what lies outside the aligned part
+        ::munmap(p, size);
+        p = ::mmap(nullptr, 2 * size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (p == MAP_FAILED)
+            return nullptr;
+
+        char* const begin = static_cast<char*>(p);
+        char* const aligned = reinterpret_cast<char*>(
+            (reinterpret_cast<std::uintptr_t>(begin) + size - 1) /
+            size * size
+        );
+        if (aligned != begin)
+            ::munmap(begin, aligned - begin);
+        ::munmap(aligned + size, begin + size - aligned);
+
+        return aligned;
+    }
+#endif
+
+    chunk* map_chunk(std::size_t size)
+    {
+#ifdef AQ_ARENA_USE_MMAP
+        void* p;
+
+#   ifdef MAP_HUGETLB
+        p = map_aligned(size, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB);
+        if (p)
+            return static_cast<chunk*>(p);
+#   endif
+
+        // No huge pages reserved by the system. Map regular pages instead,
+        // so that transparent huge pages can back them.
+        p = map_aligned(size, MAP_PRIVATE | MAP_ANONYMOUS);
+        if (!p)
+            throw std::bad_alloc();
+
+#   ifdef MADV_HUGEPAGE
+        ::madvise(p, size, MADV_HUGEPAGE);
+#   endif
+
+        return static_cast<chunk*>(p);
+#else
+        void* raw = ::operator new(2 * size);
+        chunk* c = reinterpret_cast<chunk*>(
+            (reinterpret_cast<std::uintptr_t>(raw) + size - 1) / size * size
+        );
+        c->raw = raw;
+        return c;
+#endif
+    }
+
+    void release_chunk(chunk* c) const noexcept
+    {
+#ifdef AQ_ARENA_USE_MMAP
+        ::munmap(c, chunk_size_);
+#else
+        ::operator delete(c->raw);
+#endif
+    }
+
+    const std::size_t chunk_size_ /**< Size and alignment of each chunk. */;
+    unsigned chunk_shift_ /**< log2 of the number of blocks in a chunk. */;
+    std::size_t chunk_limit_ /**< Maximum number of chunks. */;
+    free_list free_[class_count] /**< Free lists, one per size class. */;
+
+    std::unique_ptr<chunk*[]> chunks_ /**< All chunks, by number. */;
+    std::mutex mutex_ /**< Protects the members below. */;
+    std::size_t chunk_count_ /**< Number of chunks in chunks_. */;
+    char* cursor_ /**< Next unused byte in the current chunk. */;
+    char* end_ /**< End of the current chunk. */;
+    std::atomic_size_t reserved_ /**< Bytes in all chunks. */;
+};
+
+
+/** An allocator that takes its memory from an arena.
+*
+* Copies of an allocator, including rebound ones, share the same arena. The
+* arena and all of its memory are released when the last of them is
+* destroyed.
+*
+* Used as the allocator of atomic_queue_base, nodes are reused through the
+* free lists of the arena, and the destructor of the queue does not
+* deallocate the remaining nodes one by one. For trivially destructible
+* types it doesn't even walk the list. Note that the nodes of a destroyed
+* queue are only given back when the arena goes away, so don't keep one
+* arena alive across many short-lived queues.
+*
+* @tparam T Type of the objects to allocate.
+*/
+template <typename T>
+class arena_allocator
+{
+public:
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind { typedef arena_allocator<U> other; };
+
+    /** Construct an allocator with an arena of its own.
+    *
+    * @param chunk_size Size of the chunks of the arena, see arena::arena().
+    * @throws std::bad_alloc
+    */
+    explicit arena_allocator(std::size_t chunk_size = 0)
+        : arena_(std::make_shared<arena>(chunk_size))
+    { }
+
+    /** Construct an allocator that shares the arena of another. */
+    template <typename U>
+    arena_allocator(const arena_allocator<U>& other) noexcept
+        : arena_(other.arena_)
+    { }
+
+    /** Allocate memory for n objects.
+    *
+    * @throws std::bad_alloc
+    */
+    T* allocate(std::size_t n)
+    {
+        static_assert(
+            std::alignment_of<T>::value <= arena::block_alignment,
+            "arena_allocator supports alignments of up to 16 bytes."
+        );
+
+        if (n > std::size_t(-1) / sizeof(T))
+            throw std::bad_alloc();
+        return static_cast<T*>(arena_->allocate(n * sizeof(T)));
+    }
+
+    /** Deallocate memory returned by allocate(n). */
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        arena_->deallocate(p, n * sizeof(T));
+    }
+
+    /** Get the number of bytes reserved by the arena. */
+    std::size_t reserved() const noexcept
+    { return arena_->reserved(); }
+
+    template <typename U>
+    bool operator==(const arena_allocator<U>& other) const noexcept
+    { return arena_ == other.arena_; }
+
+    template <typename U>
+    bool operator!=(const arena_allocator<U>& other) const noexcept
+    { return arena_ != other.arena_; }
+
+private:
+    template <typename U> friend class arena_allocator;
+
+    std::shared_ptr<arena> arena_ /**< The shared arena. */;
+};
+
+// arena_allocator has no construct() and destroy() members
+template <typename U>
+struct has_plain_construct<arena_allocator<U> > : std::true_type
+{ };
+
+template <typename U>
+struct releases_wholesale<arena_allocator<U> > : std::true_type
+{ };
+
+} // namespace detail
+
+using detail::arena_allocator;
+
+} // namespace aq
+
+#undef AQ_ARENA_USE_MMAP
+
+#endif // ifndef ARENA_ALLOCATOR_HPP_INCLUDED
@@ -32,7 +32,10 @@
 #define ATOMIC_QUEUE_HPP_INCLUDED
 
 #include <cstddef>
+#include <cstring>
+#include <iterator>
 #include <memory>
+#include <type_traits>
 #include <atomic>
 #include <thread>
 
@@ -53,6 +56,46 @@ struct node
     std::atomic<node<T>*> next /**< Next node in list */;
 };
 
+/** Whether construct() and destroy() of an allocator are known to be plain
+* placement new and destructor calls.
+*
+* Specialize this for allocators that don't have construct() or destroy()
+* members, so that trivial values can be copied bytewise.
+*/
+template <typename Allocator>
+struct has_plain_construct : std::false_type
+{ };
+
+template <typename U>
+struct has_plain_construct<std::allocator<U> > : std::true_type
+{ };
+
+/** Whether an allocator gives back all of its memory at once when it is
+* destroyed, so that nodes left in a queue need not be deallocated one by one.
+*
+* Specialize this for arena-style allocators.
+*/
+template <typename Allocator>
+struct releases_wholesale : std::false_type
+{ };
+
+/** Whether objects of type T in a queue with the given allocator may be
+* copied with memcpy() and left alone on destruction.
+*/
+template <typename T, typename Allocator>
+struct is_trivial_value
+    : std::integral_constant<bool,
+// libstdc++ before GCC 5 doesn't know is_trivially_copyable
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 5
+        std::is_trivial<T>::value &&
+#else
+        std::is_trivially_copyable<T>::value &&
+        std::is_trivially_destructible<T>::value &&
+#endif
+        has_plain_construct<Allocator>::value
+    >
+{ };
+
 
 /** A thread-safe and lock-free queue container.
 *
@@ -62,6 +105,11 @@ struct node
 * To remove and retrieve elements, use the pop_front() function, but remember to
 * deallocate the value with deallocate() after using it.
 *
+* push_back() never waits for other threads. pop_front() does: when it finds
+* the last node while a push_back() has taken the back of the queue but not
+* linked its node yet, it yields until that push_back() is done. A producer
+* that is preempted or stalled at that point stalls the consumers with it.
+*
 * @tparam T Type of the objects this queue will hold.
 * @tparam Allocator Allocator type
 */
@@ -89,16 +137,7 @@ public:
     */
     ~atomic_queue_base() noexcept
     {
-        node<T>* fr = front_;
-
-        while(fr)
-        {
-            node<T>* next = fr->next;
-            NodeAllocatorTraits::destroy(alc_, fr);
-            NodeAllocatorTraits::deallocate(alc_, fr, 1);
-            fr = next;
-        }
-
+        destroy_nodes(releases_wholesale<Allocator>());
     }
 
 
@@ -114,17 +153,7 @@ public:
     {
         auto new_node = NodeAllocatorTraits::allocate(alc_, 1);
 
-        try {
-            ValueAllocator alc(alc_);
-            ValueAllocatorTraits::construct(
-               alc,
-               &new_node->t, t
-            );
-        } catch(...)
-        {
-            NodeAllocatorTraits::deallocate(alc_, new_node, 1);
-            throw;
-        }
+        construct_value(new_node, t, trivial_value());
         new_node->next = nullptr;
 
         push_node(new_node);
@@ -142,19 +171,70 @@ public:
     {
         auto new_node = NodeAllocatorTraits::allocate(alc_, 1);
 
+        construct_value(new_node, std::move(t), trivial_value());
+        new_node->next = nullptr;
+
+        push_node(new_node);
+    }
+
+    /** Push a range of objects into the queue by copying them.
+    *
+    * All objects are linked together first and then appended to the queue at
+    * once, so they end up next to each other in the queue, even if other
+    * threads push at the same time.
+    *
+    * @param first, last Range of objects you want to push into the queue.
+    * Requires T to be constructible from the value type of the range.
+    * @throws Any exceptions thrown by the constructor of the objects. If an
+    * exception is thrown, none of the objects are pushed.
+    *
+    * @note This function is Thread-safe, lock-free and wait-free.
+    */
+    template <typename InputIt>
+    void push_back(InputIt first, InputIt last)
+    {
+        typedef std::integral_constant<bool,
+            trivial_value::value &&
+            std::is_same<
+                typename std::iterator_traits<InputIt>::value_type, T
+            >::value
+        > copy_bytewise;
+
+        node<T>* chain_front = nullptr;
+        node<T>* chain_back = nullptr;
+        std::size_t count = 0;
+
         try {
-            ValueAllocator alc(alc_);
-            ValueAllocatorTraits::construct(
-               alc, &new_node->t, std::move(t)
-            );
+            for (; first != last; ++first, ++count)
+            {
+                auto new_node = NodeAllocatorTraits::allocate(alc_, 1);
+
+                construct_value(new_node, *first, copy_bytewise());
+                new_node->next.store(nullptr, std::memory_order_relaxed);
+
+                if (chain_back)
+                    chain_back->next.store(
+                        new_node, std::memory_order_relaxed
+                    );
+                else
+                    chain_front = new_node;
+                chain_back = new_node;
+            }
         } catch(...)
         {
-            NodeAllocatorTraits::deallocate(alc_, new_node, 1);
+            while (chain_front)
+            {
+                node<T>* next =
+                    chain_front->next.load(std::memory_order_relaxed);
+                destroy_node(chain_front, trivial_value());
+                NodeAllocatorTraits::deallocate(alc_, chain_front, 1);
+                chain_front = next;
+            }
             throw;
         }
-        new_node->next = nullptr;
 
-        push_node(new_node);
+        if (chain_front)
+            push_nodes(chain_front, chain_back, count);
     }
 
 // I WANT C++11!!! NOW!!!
@@ -172,16 +252,13 @@ public:
     {
         auto new_node = NodeAllocatorTraits::allocate(alc_, 1);
 
-        try {
-            ValueAllocator alc(alc_);
-            ValueAllocatorTraits::construct(
-               alc, &new_node->t, std::forward<Args>(args)...
-            );
-        } catch(...)
-        {
-            NodeAllocatorTraits::deallocate(alc_, new_node, 1);
-            throw;
-        }
+        emplace_value(
+            std::integral_constant<bool,
+                trivial_value::value &&
+                std::is_nothrow_constructible<T, Args&&...>::value
+            >(),
+            new_node, std::forward<Args>(args)...
+        );
         new_node->next = nullptr;
 
         push_node(new_node);
@@ -199,24 +276,47 @@ public:
     *
     * @return A pointer to the object that was removed from the queue.
     *
-    * @note This function is Thread-safe, lock-free but not wait-free.
+    * @note This function is Thread-safe, but blocking: it waits for a
+    * push_back() that has taken the back of the queue to link its node.
+    * It is not lock-free.
     */
     T* pop_front() noexcept
     {
         node<T>* old_front = front_;
-        node<T>* new_front;
 
-        do {
+        for (;;)
+        {
             if (!old_front) return nullptr; // nothing to pop
-            new_front = old_front->next;
-        } while(!front_.compare_exchange_weak(old_front, new_front));
 
-        --size_;
+            node<T>* new_front = old_front->next;
+            if (new_front)
+            {
+                if (front_.compare_exchange_weak(old_front, new_front))
+                    break;
+                continue;
+            }
+
+            // old_front looks like the last node. Taking it off the back
+            // makes it ours, since no push_back() can link a node to it
+            // afterwards.
+            node<T>* expected = old_front;
+            if (back_.compare_exchange_strong(expected, nullptr))
+            {
+                // a push_back() that found the queue empty may have set a new
+                // front already
+                expected = old_front;
+                front_.compare_exchange_strong(expected, nullptr);
+                break;
+            }
+
+            // Either a push_back() is about to link a node to old_front, or
+            // another thread took it off the back and is about to update the
+            // front.
+            std::this_thread::yield();
+            old_front = front_;
+        }
 
-        // if the old front was also the back, the queue is now empty.
-        new_front = old_front;
-        if(back_.compare_exchange_strong(new_front, nullptr))
-            old_front->next = old_front;
+        --size_;
 
         return reinterpret_cast<T*>(old_front);
     }
@@ -230,21 +330,16 @@ public:
     *
     * @param obj A pointer to an object returned by pop_front().
     *
-    * @note This function is Thread-safe, lock-free but not wait-free.
+    * @note This function is Thread-safe and doesn't wait for other threads.
+    * It is wait-free if the deallocate() of the allocator is.
     */
     void deallocate(T* obj) noexcept
     {
         if (!obj) return;
 
-        // call destructor
-        NodeAllocatorTraits::destroy(alc_, reinterpret_cast<node<T>*>(obj));
-
-        // nodes with next == 0 are still referenced by an executing
-        // push_back() function and the next ptr will be modified.
-        // Since we don't want push_back() to write to deallocated memory, we hang
-        // in a loop until the node has a non-zero next ptr.
-        while(!reinterpret_cast<node<T>*>(obj)->next.load())
-            std::this_thread::yield();
+        // call destructor. pop_front() only returns nodes that no push_back()
+        // is going to link to anymore, so the node can go right away.
+        destroy_node(reinterpret_cast<node<T>*>(obj), trivial_value());
 
         NodeAllocatorTraits::deallocate(
             alc_, reinterpret_cast<node<T>*>(obj), 1
@@ -270,19 +365,114 @@ public:
 
 protected:
 
+    typedef is_trivial_value<T, Allocator> trivial_value;
+
     void push_node(node<T>* new_node) noexcept
     {
-        node<T>* old_back = back_.exchange(new_node);
-        node<T>* null_node = nullptr;
+        push_nodes(new_node, new_node, 1u);
+    }
+
+    /** Append an already linked chain of count nodes to the queue. */
+    void push_nodes(
+        node<T>* first, node<T>* last, std::size_t count
+    ) noexcept
+    {
+        size_ += count;
+
+        node<T>* old_back = back_.exchange(last);
+
+        // If there was no back node, the queue was empty and the chain becomes
+        // the front. Deciding this by back_ rather than front_ matters: a
+        // pop_front() that takes the last node clears back_ before front_.
+        if (!old_back)
+            front_ = first;
+        else
+            // otherwise link it to the previous node. pop_front() doesn't
+            // take that node before this is done.
+            old_back->next = first;
+    }
+
+    // Trivial values are copied bytewise, so there is nothing that can throw.
+    void construct_value(node<T>* n, const T& t, std::true_type) noexcept
+    {
+        std::memcpy(&n->t, &t, sizeof(T));
+    }
+
+    // Construct the value through the allocator. If that throws, the node is
+    // deallocated before the exception is passed on.
+    template <typename U>
+    void construct_value(node<T>* n, U&& u, std::false_type)
+    {
+        try {
+            NodeAllocatorTraits::construct(alc_, &n->t, std::forward<U>(u));
+        } catch(...)
+        {
+            NodeAllocatorTraits::deallocate(alc_, n, 1);
+            throw;
+        }
+    }
 
-        // if front_ was set to null (no node yet), we have to update the front_
-        // pointer.
-        if(!front_.compare_exchange_strong(null_node, new_node))
-            // if front_ is not null, then there was a previous node.
-            // We have to update this nodes next pointer.
-            old_back->next  = new_node;
+#if !(defined(_MSC_VER) && _MSC_VER <= 1700)
+    template <typename... Args>
+    void emplace_value(std::true_type, node<T>* n, Args&&... args) noexcept
+    {
+        ::new(static_cast<void*>(&n->t)) T(std::forward<Args>(args)...);
+    }
 
-        ++size_;
+    template <typename... Args>
+    void emplace_value(std::false_type, node<T>* n, Args&&... args)
+    {
+        try {
+            NodeAllocatorTraits::construct(
+               alc_, &n->t, std::forward<Args>(args)...
+            );
+        } catch(...)
+        {
+            NodeAllocatorTraits::deallocate(alc_, n, 1);
+            throw;
+        }
+    }
+#endif
+
+    // Destroy and deallocate every node left in the queue.
+    void destroy_nodes(std::false_type) noexcept
+    {
+        node<T>* fr = front_;
+
+        while(fr)
+        {
+            node<T>* next = fr->next;
+            destroy_node(fr, trivial_value());
+            NodeAllocatorTraits::deallocate(alc_, fr, 1);
+            fr = next;
+        }
+    }
+
+    // The allocator frees the memory of all nodes at once, so only the
+    // destructors have to run, and the list isn't even walked if they are
+    // trivial.
+    void destroy_nodes(std::true_type) noexcept
+    {
+        if (std::is_trivially_destructible<T>::value)
+            return;
+
+        node<T>* fr = front_;
+
+        while(fr)
+        {
+            node<T>* next = fr->next;
+            destroy_node(fr, std::false_type());
+            fr = next;
+        }
+    }
+
+    // Trivial values need no destruction.
+    void destroy_node(node<T>*, std::true_type) noexcept
+    { }
+
+    void destroy_node(node<T>* n, std::false_type) noexcept
+    {
+        NodeAllocatorTraits::destroy(alc_, n);
     }
 
     typedef Allocator ValueAllocator;
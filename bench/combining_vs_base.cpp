@@ -0,0 +1,147 @@
+// Throughput of atomic_queue_base and combining_queue for a growing number of
+// threads. All threads first push their elements at the same time, then they
+// all pop them again.
+//
+// Pushes and pops are not mixed, and the elements popped from the
+// atomic_queue_base are only deallocated after the pop phase. Concurrent
+// pop_front() calls on atomic_queue_base read the successor of a node that
+// another thread may have popped already; if that node were deallocated (and
+// its memory reused by a push), this would be a use-after-free and could hit
+// the ABA problem described in the README. Keeping all nodes alive until the
+// phase is over rules both out. The push phase stresses the exchange of the
+// back pointer, the pop phase the compare-exchange of the front pointer.
+
+#include "atomic_queue.hpp"
+#include "combining_queue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+
+
+#ifndef BENCH_MAX_THREADCOUNT
+#    define BENCH_MAX_THREADCOUNT 64
+#endif
+
+#ifndef BENCH_PUSHCOUNT
+#    define BENCH_PUSHCOUNT 100000
+#endif
+
+
+// atomic_queue_base takes an allocator instead of a slot count. Popped
+// elements are kept per thread until finish().
+struct base_queue : aq::atomic_queue_base<unsigned>
+{
+    explicit base_queue(std::size_t threadcount)
+        : popped_(threadcount)
+    {
+        for (auto& v: popped_)
+            v.reserve(BENCH_PUSHCOUNT);
+    }
+
+    void finish()
+    {
+        for (auto& v: popped_)
+            for (auto p: v)
+                deallocate(p);
+    }
+
+    std::vector<std::vector<unsigned*> > popped_;
+};
+
+struct combining_queue : aq::combining_queue<unsigned>
+{
+    explicit combining_queue(std::size_t threadcount)
+        : aq::combining_queue<unsigned>(threadcount)
+    { }
+
+    void finish() { }
+};
+
+
+/** Run body(queue, thread index, i) BENCH_PUSHCOUNT times in each thread.
+*
+* @return Run time in seconds, from the moment all threads are ready.
+*/
+template <typename Queue, typename Body>
+double run_phase(Queue& queue, unsigned threadcount, Body body)
+{
+    std::vector<std::thread> threadvec;
+    std::atomic<unsigned> ready(0);
+    std::atomic<bool> go(false);
+
+    for (unsigned ti = 0; ti < threadcount; ++ti)
+        threadvec.push_back(std::thread(
+        [&, ti]{
+            ++ready;
+            while (!go.load())
+                std::this_thread::yield();
+
+            for (unsigned oi = 0; oi < BENCH_PUSHCOUNT; ++oi)
+                body(queue, ti, oi);
+        }
+        ));
+
+    while (ready.load() != threadcount)
+        std::this_thread::yield();
+
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    for (auto& t: threadvec)
+        t.join();
+    auto stop = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(stop - start).count();
+}
+
+/** Millions of operations per second for pushing and popping everything. */
+template <typename Queue, typename Push, typename Pop>
+double run(unsigned threadcount, Push push, Pop pop)
+{
+    Queue queue(threadcount);
+
+    double seconds = run_phase(queue, threadcount, push);
+    seconds += run_phase(queue, threadcount, pop);
+    queue.finish();
+
+    return 2.0 * BENCH_PUSHCOUNT * threadcount / seconds / 1e6;
+}
+
+int main()
+{
+    std::cout<<"hardware threads: "<<std::thread::hardware_concurrency()<<"\n"
+        <<"threads  atomic_queue_base  combining_queue  ratio\n"
+        <<"         [Mops/s]           [Mops/s]\n";
+
+    for (unsigned threadcount = 1; threadcount <= BENCH_MAX_THREADCOUNT;
+         threadcount *= 2)
+    {
+        double base_mops = run<base_queue>(threadcount,
+            [](base_queue& q, unsigned, unsigned i) {
+                q.push_back(i);
+            },
+            [](base_queue& q, unsigned ti, unsigned) {
+                q.popped_[ti].push_back(q.pop_front());
+            }
+        );
+
+        double combining_mops = run<combining_queue>(threadcount,
+            [](combining_queue& q, unsigned, unsigned i) {
+                q.push_back(i);
+            },
+            [](combining_queue& q, unsigned, unsigned i) {
+                q.pop_front(i);
+            }
+        );
+
+        std::cout<<std::setw(7)<<threadcount
+            <<std::setw(19)<<std::fixed<<std::setprecision(2)<<base_mops
+            <<std::setw(17)<<combining_mops
+            <<std::setw(7)<<combining_mops / base_mops<<std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,467 @@
+/*
+* Copyright (c) 2012 Alexander Korsunsky <fat.lobyte9@gmail.com>
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+* 1. Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+* IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+* THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+* PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+* OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+* OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BOUNDED_QUEUE_HPP_INCLUDED
+#define BOUNDED_QUEUE_HPP_INCLUDED
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "atomic_queue.hpp"
+#include "thread_index.hpp"
+
+namespace aq {
+
+namespace detail {
+
+/** Capacity of a bounded_queue given as a memory budget. */
+struct byte_budget
+{
+    explicit byte_budget(std::size_t b) noexcept
+        : bytes(b)
+    { }
+
+    std::size_t bytes /**< Number of bytes the nodes may occupy. */;
+};
+
+
+/** An atomic_queue_base with a limited capacity.
+*
+* The capacity is either a number of elements, or a number of bytes that the
+* nodes of the queue may occupy. Each element occupies one node allocated
+* through the allocator, so a byte budget is turned into a number of nodes
+* (overhead of the allocator itself is not accounted for).
+*
+* Capacity is handed out as credits. try_push_back() fails if there are no
+* credits left and push_back_wait() blocks until an element is deallocated.
+* Credits are returned by deallocate(), not by pop_front(), because the
+* memory is only freed there.
+*
+* Credits move in chunks between a shared pool and a cache per thread (or
+* per group of threads, if there are more threads than hardware threads).
+* Pushes take their credit from the cache of the calling thread, and
+* deallocate() puts it back there, so in the common case neither touches a
+* cache line that other threads write to. Only a cache that runs empty or
+* overflows exchanges a chunk with the pool. When the pool is empty, credits
+* are taken from the caches of other threads, so cached credits never keep
+* the queue from filling up. A producer goes one step further and keeps its
+* credits in a plain counter.
+*
+* @tparam T Type of the objects this queue will hold.
+* @tparam Allocator Allocator type
+*/
+template <typename T, typename Allocator = std::allocator<T> >
+class bounded_queue
+    : private atomic_queue_base<T, Allocator>
+{
+    typedef atomic_queue_base<T, Allocator> base;
+
+public:
+
+    /** A thread's handle for pushing into a bounded_queue.
+    *
+    * A producer takes credits from the queue in chunks and keeps the
+    * unused ones until it is destroyed, so up to chunk - 1 elements of
+    * capacity may be held back by each producer. A producer must only be
+    * used by one thread at the same time.
+    */
+    class producer
+    {
+    public:
+
+        /** Construct a producer.
+        *
+        * @param q Queue to push into.
+        * @param chunk Number of credits to take at once. If zero, a chunk
+        * size is derived from the capacity of the queue.
+        */
+        explicit producer(bounded_queue& q, std::size_t chunk = 0) noexcept
+            : q_(q), chunk_(chunk ? chunk : q.chunk_), credits_(0)
+        { }
+
+        /** Destructor. Returns unused credits to the queue. */
+        ~producer() noexcept
+        { q_.give_back(credits_); }
+
+        /** Push object into the queue by copying it, if there is room.
+        *
+        * @param t Object you want to push into the queue.
+        * @return false if the queue is full, true otherwise.
+        * @throws Any exceptions thrown by the copy constructor of the object.
+        *
+        * @note This function is lock-free.
+        */
+        bool try_push_back(const T& t)
+        {
+            if (!credits_ && !(credits_ = q_.take(chunk_)))
+                return false;
+
+            q_.base::push_back(t);
+            --credits_;
+            return true;
+        }
+
+        /** Push object into the queue by moving it, if there is room.
+        *
+        * @see try_push_back(const T&)
+        */
+        bool try_push_back(T&& t)
+        {
+            if (!credits_ && !(credits_ = q_.take(chunk_)))
+                return false;
+
+            q_.base::push_back(std::move(t));
+            --credits_;
+            return true;
+        }
+
+        /** Push object into the queue by copying it, wait for room.
+        *
+        * @param t Object you want to push into the queue.
+        * @throws Any exceptions thrown by the copy constructor of the object.
+        *
+        * @note If the queue is full, this function blocks until another
+        * thread deallocates an object.
+        */
+        void push_back_wait(const T& t)
+        {
+            if (!credits_)
+                credits_ = q_.take_wait(chunk_);
+
+            q_.base::push_back(t);
+            --credits_;
+        }
+
+        /** Push object into the queue by moving it, wait for room.
+        *
+        * @see push_back_wait(const T&)
+        */
+        void push_back_wait(T&& t)
+        {
+            if (!credits_)
+                credits_ = q_.take_wait(chunk_);
+
+            q_.base::push_back(std::move(t));
+            --credits_;
+        }
+
+    private:
+        producer(const producer&);
+        producer& operator=(const producer&);
+
+        bounded_queue& q_ /**< Queue to push into. */;
+        std::size_t chunk_ /**< Number of credits to take at once. */;
+        std::size_t credits_ /**< Credits taken, but not used yet. */;
+    };
+
+    /** Construct an empty queue with room for a number of elements.
+    *
+    * @param capacity Maximum number of elements in the queue.
+    * @param alc Allocator object that is to be used for memory
+    * allocation/deallocation.
+    * @throws std::bad_alloc
+    */
+    explicit bounded_queue(
+        std::size_t capacity,
+        const Allocator& alc = Allocator()
+    )
+        : base(alc), capacity_(capacity)
+    {
+        init();
+    }
+
+    /** Construct an empty queue whose nodes may occupy a number of bytes.
+    *
+    * @param budget Maximum memory occupied by the nodes.
+    * @param alc Allocator object that is to be used for memory
+    * allocation/deallocation.
+    * @throws std::bad_alloc
+    */
+    explicit bounded_queue(
+        byte_budget budget,
+        const Allocator& alc = Allocator()
+    )
+        : base(alc), capacity_(budget.bytes / sizeof(node<T>))
+    {
+        init();
+    }
+
+    /** Push object into the queue by copying it, if there is room.
+    *
+    * @param t Object you want to push into the queue.
+    * @return false if the queue is full, true otherwise.
+    * @throws Any exceptions thrown by the copy constructor of the object.
+    *
+    * @note This function is Thread-safe and lock-free.
+    */
+    bool try_push_back(const T& t)
+    {
+        if (!take_one()) return false;
+
+        try {
+            base::push_back(t);
+        } catch(...)
+        {
+            give_back(1);
+            throw;
+        }
+        return true;
+    }
+
+    /** Push object into the queue by moving it, if there is room.
+    *
+    * @see try_push_back(const T&)
+    */
+    bool try_push_back(T&& t)
+    {
+        if (!take_one()) return false;
+
+        try {
+            base::push_back(std::move(t));
+        } catch(...)
+        {
+            give_back(1);
+            throw;
+        }
+        return true;
+    }
+
+    /** Push object into the queue by copying it, wait for room.
+    *
+    * @param t Object you want to push into the queue.
+    * @throws Any exceptions thrown by the copy constructor of the object.
+    *
+    * @note This function is Thread-safe. If the queue is full, it blocks
+    * until another thread deallocates an object.
+    */
+    void push_back_wait(const T& t)
+    {
+        take_one_wait();
+
+        try {
+            base::push_back(t);
+        } catch(...)
+        {
+            give_back(1);
+            throw;
+        }
+    }
+
+    /** Push object into the queue by moving it, wait for room.
+    *
+    * @see push_back_wait(const T&)
+    */
+    void push_back_wait(T&& t)
+    {
+        take_one_wait();
+
+        try {
+            base::push_back(std::move(t));
+        } catch(...)
+        {
+            give_back(1);
+            throw;
+        }
+    }
+
+    using base::pop_front;
+
+    /** Deallocate an object returned by pop_front().
+    *
+    * This frees room for another object.
+    *
+    * @see atomic_queue_base::deallocate()
+    */
+    void deallocate(T* obj) noexcept
+    {
+        if (!obj) return;
+
+        base::deallocate(obj);
+        give_back(1);
+    }
+
+    using base::size;
+
+    /** Maximum number of elements in the queue. */
+    std::size_t capacity() const noexcept
+    { return capacity_; }
+
+private:
+    bounded_queue(const bounded_queue&);
+    bounded_queue& operator=(const bounded_queue&);
+
+    /** Credits cached for the threads that map to it. */
+    struct stripe
+    {
+        std::atomic<std::size_t> credits;
+        char pad[64 - sizeof(std::atomic<std::size_t>)];
+    };
+
+    void init()
+    {
+        std::size_t chunk = capacity_ / 16;
+        chunk_ = chunk < 1 ? 1 : chunk > 64 ? 64 : chunk;
+
+        std::size_t count = 1;
+        std::size_t threads = std::thread::hardware_concurrency();
+        while (count < threads)
+            count <<= 1;
+
+        stripes_.reset(new stripe[count]);
+        stripe_mask_ = count - 1;
+        for (std::size_t i = 0; i < count; ++i)
+            stripes_[i].credits.store(0, std::memory_order_relaxed);
+
+        free_.store(capacity_, std::memory_order_relaxed);
+        waiters_.store(0, std::memory_order_relaxed);
+    }
+
+    stripe& own_stripe() const noexcept
+    { return stripes_[this_thread_index() & stripe_mask_]; }
+
+    /** Take up to n credits from c. Returns the number taken. */
+    static std::size_t take_from(
+        std::atomic<std::size_t>& c, std::size_t n
+    ) noexcept
+    {
+        std::size_t avail = c.load(std::memory_order_relaxed);
+        std::size_t taken;
+
+        do {
+            if (!avail) return 0;
+            taken = avail < n ? avail : n;
+        } while(!c.compare_exchange_weak(avail, avail - taken));
+
+        return taken;
+    }
+
+    /** Take up to n credits from the pool, or from any cache if the pool is
+    * empty. Returns the number taken. */
+    std::size_t take(std::size_t n) noexcept
+    {
+        std::size_t taken = take_from(free_, n);
+        if (taken) return taken;
+
+        const std::size_t own = this_thread_index();
+        for (std::size_t i = 0; i <= stripe_mask_; ++i)
+            if ((taken = take_from(
+                    stripes_[(own + i) & stripe_mask_].credits, n)))
+                return taken;
+
+        return 0;
+    }
+
+    /** Take up to n credits, wait for at least one. */
+    std::size_t take_wait(std::size_t n)
+    {
+        std::size_t taken = take(n);
+        if (taken) return taken;
+
+        std::unique_lock<std::mutex> lk(wait_mtx_);
+
+        waiters_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        while (!(taken = take(n)))
+            wait_cv_.wait(lk);
+
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+        return taken;
+    }
+
+    /** Take one credit for the calling thread. */
+    bool take_one() noexcept
+    {
+        if (take_from(own_stripe().credits, 1))
+            return true;
+
+        // refill the cache with a chunk
+        std::size_t taken = take(chunk_);
+        if (!taken) return false;
+
+        give_back(taken - 1);
+        return true;
+    }
+
+    /** Take one credit for the calling thread, wait until there is one. */
+    void take_one_wait()
+    {
+        if (take_one()) return;
+
+        give_back(take_wait(chunk_) - 1);
+    }
+
+    /** Return n credits to the cache of the calling thread and wake up
+    * waiting threads. */
+    void give_back(std::size_t n) noexcept
+    {
+        if (!n) return;
+
+        stripe& s = own_stripe();
+        std::size_t cached = s.credits.fetch_add(n) + n;
+
+        // hand everything beyond one chunk over to the pool
+        if (cached > 2 * chunk_ &&
+                s.credits.compare_exchange_strong(cached, chunk_))
+            free_.fetch_add(cached - chunk_);
+
+        // Pairs with the fence in take_wait(): either the waiter finds the
+        // credits, or we see the waiter. The read-modify-writes above are
+        // sequentially consistent, so no fence is needed on this side.
+        if (!waiters_.load()) return;
+
+        std::lock_guard<std::mutex> lk(wait_mtx_);
+        wait_cv_.notify_all();
+    }
+
+    std::size_t capacity_ /**< Maximum number of elements. */;
+    std::size_t chunk_ /**< Credits moved between pool and cache at once. */;
+    std::unique_ptr<stripe[]> stripes_ /**< Credit caches. */;
+    std::size_t stripe_mask_ /**< Number of caches minus one. */;
+
+    char pad0_[64];
+    std::atomic<std::size_t> free_ /**< Credits in the pool. */;
+    char pad1_[64 - sizeof(std::atomic<std::size_t>)];
+
+    std::atomic<unsigned> waiters_ /**< Number of threads in take_wait(). */;
+    std::mutex wait_mtx_;
+    std::condition_variable wait_cv_;
+};
+
+} // namespace detail
+
+using detail::byte_budget;
+using detail::bounded_queue;
+
+} // namespace aq
+
+#endif // ifndef BOUNDED_QUEUE_HPP_INCLUDED
@@ -0,0 +1,356 @@
+/*
+* Copyright (c) 2012 Alexander Korsunsky <fat.lobyte9@gmail.com>
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+* 1. Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+* IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+* THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+* PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+* OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+* OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BROADCAST_QUEUE_HPP_INCLUDED
+#define BROADCAST_QUEUE_HPP_INCLUDED
+
+#include <cstddef>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <initializer_list>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+namespace aq {
+
+namespace detail {
+
+/** A queue where every consumer sees every element.
+*
+* Elements are stored in a preallocated ring. A single producer thread adds
+* elements with push_back() or emplace_back(), and every registered consumer
+* walks over all of them with its own cursor, using consume(). An element is
+* only overwritten after every consumer has seen it.
+*
+* A consumer can be registered with dependencies on other consumers. It then
+* only sees an element after all of its dependencies are done with it, e.g.
+* a metrics consumer that must only count events that have been journaled and
+* replicated.
+*
+* All consumers must be registered with add_consumer() before the first
+* element is pushed. After that, one thread may push and each consumer may be
+* used by one thread at the same time.
+*
+* @tparam T Type of the objects this queue will hold.
+* @tparam Allocator Allocator type
+*/
+template <typename T, typename Allocator = std::allocator<T> >
+class broadcast_queue
+{
+public:
+
+    /** Handle of a consumer, returned by add_consumer(). */
+    class consumer
+    {
+        friend class broadcast_queue;
+
+        explicit consumer(std::size_t index) noexcept
+            : index_(index)
+        { }
+
+        std::size_t index_ /**< Index into cursors_. */;
+    };
+
+    /** Construct an empty queue.
+    *
+    * @param capacity Number of elements in the ring. Rounded up to a power of
+    * two.
+    * @param alc Allocator object that is to be used for memory
+    * allocation/deallocation.
+    * @throws Any exceptions thrown by the allocator.
+    */
+    explicit broadcast_queue(
+        std::size_t capacity,
+        const Allocator& alc = Allocator()
+    )
+        : ring_(nullptr), mask_(0), alc_(alc), next_(0), cached_gate_(0),
+        hole_(false), published_(0)
+    {
+        std::size_t cap = 1;
+        while (cap < capacity)
+            cap <<= 1;
+
+        ring_ = ValueAllocatorTraits::allocate(alc_, cap);
+        mask_ = cap - 1;
+    }
+
+    /** Destructor.
+    *
+    * Destroys all elements that are still in the ring.
+    */
+    ~broadcast_queue() noexcept
+    {
+        std::size_t first = next_ > mask_ ? next_ - mask_ - 1 : 0;
+        if (hole_) ++first;
+
+        for (std::size_t seq = first; seq != next_; ++seq)
+            ValueAllocatorTraits::destroy(alc_, &ring_[seq & mask_]);
+
+        ValueAllocatorTraits::deallocate(alc_, ring_, mask_ + 1);
+    }
+
+    /** Register a consumer.
+    *
+    * The consumer sees every element of the queue. Consumers can only be
+    * registered before the first element is pushed.
+    *
+    * @param deps Consumers that must be done with an element before the new
+    * consumer sees it.
+    * @return A handle for consume().
+    * @throws std::logic_error if an element was pushed already,
+    * std::bad_alloc.
+    *
+    * @note This function is not thread-safe.
+    */
+    consumer add_consumer(std::initializer_list<consumer> deps =
+        std::initializer_list<consumer>())
+    {
+        // A late consumer would start ahead of its dependencies, and the
+        // producer may already be waiting on gating_.
+        if (next_ != 0)
+            throw std::logic_error(
+                "broadcast_queue consumers must be added before pushing");
+
+        std::unique_ptr<cursor> c(new cursor);
+        c->seq.store(next_, std::memory_order_relaxed);
+
+        for (auto& dep: deps)
+        {
+            c->deps.push_back(cursors_[dep.index_].get());
+
+            // the producer only needs to wait for the last consumers of
+            // each chain, the others are always ahead of them.
+            gating_.erase(
+                std::remove(gating_.begin(), gating_.end(), c->deps.back()),
+                gating_.end()
+            );
+        }
+
+        gating_.reserve(gating_.size() + 1);
+        cursors_.push_back(std::move(c));
+        gating_.push_back(cursors_.back().get());
+
+        return consumer(cursors_.size() - 1);
+    }
+
+    /** Push object into the queue by copying it.
+    *
+    * If the ring is full, this function waits until the slowest consumer has
+    * seen the oldest element.
+    *
+    * @param t Object you want to push into the queue. Requires T to be
+    * CopyConstructible.
+    * @throws Any exceptions thrown by the copy constructor of the object.
+    *
+    * @note Only one thread may push at the same time. This function is
+    * lock-free, but not wait-free.
+    */
+    void push_back(const T& t)
+    {
+        wait_for_room();
+        publish(t);
+    }
+
+    /** Push object into the queue by moving it.
+    *
+    * @see push_back(const T&)
+    */
+    void push_back(T&& t)
+    {
+        wait_for_room();
+        publish(std::move(t));
+    }
+
+    /** Try to push object into the queue by copying it.
+    *
+    * @param t Object you want to push into the queue.
+    * @return false if the ring is full, true otherwise.
+    * @throws Any exceptions thrown by the copy constructor of the object.
+    *
+    * @note Only one thread may push at the same time. This function is
+    * lock-free and wait-free.
+    */
+    bool try_push_back(const T& t)
+    {
+        if (!has_room()) return false;
+        publish(t);
+        return true;
+    }
+
+    /** Create and push object into the queue.
+    *
+    * @param args... Arguments to the objects constructor
+    * @see push_back(const T&)
+    */
+    template<typename... Args>
+    void emplace_back(Args&&... args)
+    {
+        wait_for_room();
+        publish(std::forward<Args>(args)...);
+    }
+
+    /** Process all elements that are available to a consumer.
+    *
+    * Calls f for every element the consumer has not seen yet, up to the
+    * latest published element and, if the consumer has dependencies, up to
+    * the element the slowest of them has reached. The consumer's cursor is
+    * only advanced once, after the whole batch.
+    *
+    * @param c Handle of the consumer.
+    * @param f Function object with signature void(const T&).
+    * @param max Maximum number of elements to process.
+    * @return Number of elements processed.
+    * @throws Any exceptions thrown by f. The element for which f threw and
+    * the ones after it are processed again on the next call.
+    *
+    * @note Each consumer may only be used by one thread at the same time.
+    * This function is lock-free and wait-free, apart from f.
+    */
+    template <typename F>
+    std::size_t consume(consumer c, F f, std::size_t max = std::size_t(-1))
+    {
+        cursor& cur = *cursors_[c.index_];
+        const std::size_t first = cur.seq.load(std::memory_order_relaxed);
+
+        std::size_t avail =
+            published_.load(std::memory_order_acquire) - first;
+        for (auto dep: cur.deps)
+        {
+            std::size_t dep_avail =
+                dep->seq.load(std::memory_order_acquire) - first;
+            if (dep_avail < avail)
+                avail = dep_avail;
+        }
+        if (avail > max)
+            avail = max;
+
+        std::size_t seq = first;
+        try {
+            for (; seq != first + avail; ++seq)
+                f(static_cast<const T&>(ring_[seq & mask_]));
+        } catch(...)
+        {
+            cur.seq.store(seq, std::memory_order_release);
+            throw;
+        }
+
+        cur.seq.store(seq, std::memory_order_release);
+        return avail;
+    }
+
+    /** Number of elements in the ring. */
+    std::size_t capacity() const noexcept
+    { return mask_ + 1; }
+
+private:
+    broadcast_queue(const broadcast_queue&);
+    broadcast_queue& operator=(const broadcast_queue&);
+
+    /** Position of a consumer. */
+    struct cursor
+    {
+        cursor() noexcept
+            : seq(0)
+        { }
+
+        char pad0_[64];
+        std::atomic<std::size_t> seq /**< Next element to be consumed. */;
+        char pad1_[64 - sizeof(std::atomic<std::size_t>)];
+        std::vector<cursor*> deps /**< Consumers that must go first. */;
+    };
+
+    bool has_room() noexcept
+    {
+        if (next_ - cached_gate_ <= mask_)
+            return true;
+
+        // find the slowest of the consumers
+        std::size_t behind = 0;
+        for (auto c: gating_)
+        {
+            std::size_t b = next_ - c->seq.load(std::memory_order_acquire);
+            if (b > behind)
+                behind = b;
+        }
+        cached_gate_ = next_ - behind;
+
+        return behind <= mask_;
+    }
+
+    void wait_for_room() noexcept
+    {
+        while (!has_room())
+            std::this_thread::yield();
+    }
+
+    template <typename... Args>
+    void publish(Args&&... args)
+    {
+        T* slot = &ring_[next_ & mask_];
+
+        // the element that was here before has been seen by everybody
+        if (next_ > mask_ && !hole_)
+            ValueAllocatorTraits::destroy(alc_, slot);
+
+        // if this throws, the slot stays empty until the next push
+        hole_ = next_ > mask_;
+        ValueAllocatorTraits::construct(
+            alc_, slot, std::forward<Args>(args)...
+        );
+        hole_ = false;
+
+        published_.store(++next_, std::memory_order_release);
+    }
+
+    typedef std::allocator_traits<Allocator> ValueAllocatorTraits;
+
+    T* ring_ /**< The ring. */;
+    std::size_t mask_ /**< Number of elements in the ring minus one. */;
+    Allocator alc_ /**< Allocator for the ring. */;
+
+    std::vector<std::unique_ptr<cursor> > cursors_ /**< All consumers. */;
+    std::vector<cursor*> gating_ /**< Consumers the producer waits for. */;
+
+    std::size_t next_ /**< Producer: sequence of the next element. */;
+    std::size_t cached_gate_ /**< Producer: last known slowest consumer. */;
+    bool hole_ /**< Producer: the oldest element was already destroyed. */;
+
+    char pad0_[64];
+    std::atomic<std::size_t> published_ /**< Number of published elements. */;
+    char pad1_[64 - sizeof(std::atomic<std::size_t>)];
+};
+
+} // namespace detail
+
+using detail::broadcast_queue;
+
+} // namespace aq
+
+#endif // ifndef BROADCAST_QUEUE_HPP_INCLUDED
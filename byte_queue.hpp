@@ -0,0 +1,335 @@
+/*
+* Copyright (c) 2012 Alexander Korsunsky <fat.lobyte9@gmail.com>
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+* 1. Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+* IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+* THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+* PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+* OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+* OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BYTE_QUEUE_HPP_INCLUDED
+#define BYTE_QUEUE_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <memory>
+#include <atomic>
+
+namespace aq {
+
+namespace detail {
+
+/** A thread-safe queue of variable-sized byte records.
+*
+* The records are stored one after another in a ring of bytes, so neither
+* pushing nor popping a record allocates memory or copies it around.
+*
+* To add a record, claim room for it with reserve(), write the record
+* directly into the returned span and make it visible with commit().
+* To remove a record, look at it with read() and free its room with
+* release() when you are done with it.
+*
+* Any number of threads may reserve() and commit() at the same time, but only
+* one thread at a time may read() and release(). Records become readable in
+* the order in which they were reserved; a record that was reserved but not
+* yet committed holds back all records behind it.
+*
+* @tparam Allocator Allocator type for the ring.
+*/
+template <typename Allocator = std::allocator<char> >
+class basic_byte_queue
+{
+public:
+
+    /** Writable room for a record, returned by reserve(). */
+    struct span
+    {
+        char* data /**< Start of the record. Null if the reserve failed. */;
+        std::size_t size /**< Size of the record in bytes. */;
+    };
+
+    /** A readable record, returned by read(). */
+    struct const_span
+    {
+        const char* data /**< Start of the record. Null if there is none. */;
+        std::size_t size /**< Size of the record in bytes. */;
+    };
+
+    /** Construct an empty queue.
+    *
+    * @param capacity Size of the ring in bytes, at most 2 GiB. Rounded up to a
+    * power of two.
+    * Every record occupies its size rounded up to 8 bytes plus an 8 byte
+    * header. A single record can be at most half the capacity.
+    * @param alc Allocator object that is to be used for memory allocation.
+    * @throws std::length_error if capacity is larger than 2 GiB, any
+    * exceptions thrown by the allocator.
+    */
+    explicit basic_byte_queue(
+        std::size_t capacity,
+        const Allocator& alc = Allocator()
+    )
+        : ring_(nullptr), capacity_(sizeof(header) * 2), alc_(alc),
+        write_pos_(0), read_pos_(0)
+    {
+        // Sizes in the headers are 31 bits wide, the top bit marks padding.
+        if (capacity > max_capacity)
+            throw std::length_error("byte_queue capacity too large");
+
+        while (capacity_ < capacity)
+            capacity_ <<= 1;
+
+        ring_ = WordAllocatorTraits::allocate(alc_, words());
+        std::memset(ring_, 0, capacity_);
+    }
+
+    /** Destructor.
+    *
+    * @note No reserve() or read() may be outstanding.
+    */
+    ~basic_byte_queue() noexcept
+    {
+        WordAllocatorTraits::deallocate(alc_, ring_, words());
+    }
+
+    /** Claim room for a record.
+    *
+    * @param n Size of the record in bytes.
+    * @return A span of n writable bytes, or a span with a null data pointer
+    * if there is not enough free room in the ring right now or n exceeds half
+    * the capacity.
+    *
+    * @note This function is Thread-safe and lock-free.
+    */
+    span reserve(std::size_t n) noexcept
+    {
+        span s = { nullptr, 0u };
+
+        const std::size_t total = sizeof(header) + round_up(n);
+        if (n > max_record_size() || total > capacity_ / 2)
+            return s;
+
+        std::size_t pos = write_pos_.load(std::memory_order_relaxed);
+        std::size_t offset, need;
+
+        for (;;)
+        {
+            // A record never wraps around. If it doesn't fit before the end
+            // of the ring, the rest of the ring is claimed as padding.
+            offset = pos & (capacity_ - 1);
+            need = total <= capacity_ - offset ?
+                total : capacity_ - offset + total;
+
+            const std::size_t rd = read_pos_.load(std::memory_order_acquire);
+            if (static_cast<std::ptrdiff_t>(rd - pos) > 0)
+            {
+                // Other producers and the reader moved on since pos was
+                // loaded, so it is stale.
+                pos = write_pos_.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            if (pos + need - rd > capacity_)
+                return s; // not enough room
+
+            if (write_pos_.compare_exchange_weak(
+                    pos, pos + need, std::memory_order_relaxed))
+                break;
+        }
+
+        if (need != total)
+        {
+            header_at(offset)->state.store(
+                static_cast<std::uint32_t>(capacity_ - offset) | PADDING,
+                std::memory_order_release
+            );
+            offset = 0;
+        }
+
+        header_at(offset)->size = static_cast<std::uint32_t>(n);
+
+        s.data = data_at(offset);
+        s.size = n;
+        return s;
+    }
+
+    /** Make a reserved record visible to the reader.
+    *
+    * @param s A span returned by reserve(). Must not have been committed yet.
+    *
+    * @note This function is Thread-safe, lock-free and wait-free.
+    */
+    void commit(const span& s) noexcept
+    {
+        header_of(s.data)->state.store(
+            static_cast<std::uint32_t>(sizeof(header) + round_up(s.size)),
+            std::memory_order_release
+        );
+    }
+
+    /** Look at the record at the front of the queue.
+    *
+    * Calling read() again without release() returns the same record.
+    *
+    * @return A span of the record, or a span with a null data pointer if the
+    * next record is not committed yet or the queue is empty.
+    *
+    * @note This function is lock-free and wait-free, but must not be called by
+    * more than one thread at a time.
+    */
+    const_span read() noexcept
+    {
+        for(;;)
+        {
+            std::size_t pos = read_pos_.load(std::memory_order_relaxed);
+            std::size_t offset = pos & (capacity_ - 1);
+            header* h = header_at(offset);
+            std::uint32_t state = h->state.load(std::memory_order_acquire);
+
+            if (!state)
+            {
+                const_span s = { nullptr, 0u };
+                return s;
+            }
+
+            if (!(state & PADDING))
+            {
+                const_span s = { data_at(offset), h->size };
+                return s;
+            }
+
+            // skip the padding at the end of the ring
+            clear(offset, state & ~PADDING);
+            read_pos_.store(
+                pos + (state & ~PADDING), std::memory_order_release
+            );
+        }
+    }
+
+    /** Remove the record at the front of the queue.
+    *
+    * @param s The span returned by the last call to read().
+    *
+    * @note This function is lock-free and wait-free, but must not be called by
+    * more than one thread at a time.
+    */
+    void release(const const_span& s) noexcept
+    {
+        std::size_t offset = s.data - sizeof(header) - ring_data();
+        std::uint32_t total =
+            header_at(offset)->state.load(std::memory_order_relaxed);
+
+        clear(offset, total);
+        read_pos_.store(
+            read_pos_.load(std::memory_order_relaxed) + total,
+            std::memory_order_release
+        );
+    }
+
+    /** Size of the ring in bytes. */
+    std::size_t capacity() const noexcept
+    { return capacity_; }
+
+    /** Size of the largest record that reserve() can ever succeed for. */
+    std::size_t max_record_size() const noexcept
+    { return capacity_ / 2 - sizeof(header); }
+
+private:
+    basic_byte_queue(const basic_byte_queue&);
+    basic_byte_queue& operator=(const basic_byte_queue&);
+
+    /** Header in front of every record. */
+    struct header
+    {
+        /** Total size of the record including the header, or'ed with
+        * PADDING for the filler at the end of the ring. Zero if the record
+        * has not been committed yet. */
+        std::atomic<std::uint32_t> state;
+        std::uint32_t size /**< Size of the record as passed to reserve(). */;
+    };
+
+    static const std::uint32_t PADDING = 0x80000000u;
+    static const std::size_t max_capacity = std::size_t(1) << 31;
+
+    static std::size_t round_up(std::size_t n) noexcept
+    { return (n + sizeof(header) - 1) & ~(sizeof(header) - 1); }
+
+    char* ring_data() const noexcept
+    { return reinterpret_cast<char*>(ring_); }
+
+    header* header_at(std::size_t offset) const noexcept
+    { return reinterpret_cast<header*>(ring_data() + offset); }
+
+    header* header_of(const char* data) const noexcept
+    { return header_at(data - sizeof(header) - ring_data()); }
+
+    char* data_at(std::size_t offset) const noexcept
+    { return ring_data() + offset + sizeof(header); }
+
+    std::size_t words() const noexcept
+    { return capacity_ / sizeof(std::uint64_t); }
+
+    // Zero a consumed record. Any 8 byte aligned position of it may be the
+    // header of a later record, which must read as not committed until its
+    // writer commits it.
+    void clear(std::size_t offset, std::size_t total) noexcept
+    {
+        header* h = header_at(offset);
+
+        std::memset(data_at(offset), 0, total - sizeof(header));
+        h->size = 0;
+        h->state.store(0, std::memory_order_relaxed);
+    }
+
+    typedef std::allocator_traits<Allocator> ValueAllocatorTraits;
+
+    // Rebind allocator traits for Allocator to 8 byte words, so that headers
+    // are properly aligned
+    typedef
+        typename ValueAllocatorTraits::template rebind_traits<std::uint64_t>
+        WordAllocatorTraits;
+
+    typedef typename WordAllocatorTraits::allocator_type WordAllocator;
+
+    std::uint64_t* ring_ /**< The ring. */;
+    std::size_t capacity_ /**< Size of the ring in bytes. */;
+    WordAllocator alc_ /**< Allocator for the ring. */;
+
+    // keep the producer and consumer positions on separate cache lines
+    char pad0_[64];
+    std::atomic<std::size_t> write_pos_ /**< End of the last reservation. */;
+    char pad1_[64 - sizeof(std::atomic<std::size_t>)];
+    std::atomic<std::size_t> read_pos_ /**< Start of the front record. */;
+    char pad2_[64 - sizeof(std::atomic<std::size_t>)];
+};
+
+} // namespace detail
+
+using detail::basic_byte_queue;
+
+/** Byte queue with the default allocator. */
+typedef basic_byte_queue<> byte_queue;
+
+} // namespace aq
+
+#endif // ifndef BYTE_QUEUE_HPP_INCLUDED
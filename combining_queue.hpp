@@ -0,0 +1,298 @@
+/*
+* Copyright (c) 2012 Alexander Korsunsky <fat.lobyte9@gmail.com>
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+* 1. Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+* IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+* THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+* PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+* OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+* OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef COMBINING_QUEUE_HPP_INCLUDED
+#define COMBINING_QUEUE_HPP_INCLUDED
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <exception>
+#include <deque>
+#include <atomic>
+#include <thread>
+
+#include "thread_index.hpp"
+
+namespace aq {
+
+namespace detail {
+
+/** A thread-safe queue based on flat combining.
+*
+* Under heavy contention, lock-free queues spend most of their time moving
+* the cache lines of their front and back pointers between cores. This queue
+* takes the opposite approach: every thread publishes its push or pop request
+* in a publication slot of its own, and whichever thread gets hold of the
+* combiner lock
+* executes all pending requests against a plain sequential queue, then hands
+* the results back through the slots. The data of the sequential queue stays
+* in the cache of the combining thread for the whole batch.
+*
+* Unlike atomic_queue_base, pop_front() moves the element out of the queue,
+* so no deallocation is needed afterwards.
+*
+* @tparam T Type of the objects this queue will hold.
+* @tparam Allocator Allocator type
+*/
+template <typename T, typename Allocator = std::allocator<T> >
+class combining_queue
+{
+public:
+
+    /** Construct an empty queue.
+    *
+    * @param slots Number of publication slots. Each thread has a home slot
+    * that it uses whenever it is free. If the process has more threads alive
+    * at once than there are slots, some threads share their home slot and
+    * may have to look for another one. If zero, twice the number of hardware
+    * threads is used.
+    * @param alc Allocator object that is to be used for memory
+    * allocation/deallocation.
+    * @throws std::bad_alloc
+    */
+    explicit combining_queue(
+        std::size_t slots = 0,
+        const Allocator& alc = Allocator()
+    )
+        : slots_(nullptr), slot_count_(slots), queue_(alc),
+        size_(0u), combining_(false)
+    {
+        if (!slot_count_)
+            slot_count_ = 2 * std::thread::hardware_concurrency();
+        if (!slot_count_)
+            slot_count_ = 16;
+
+        slots_ = new slot[slot_count_];
+    }
+
+    /** Destructor.
+    *
+    * @note The queue is thread-safe before this function is invoked.
+    */
+    ~combining_queue() noexcept
+    {
+        delete[] slots_;
+    }
+
+    /** Push object into the queue by copying it.
+    *
+    * @param t Object you want to push into the queue. Requires T to be
+    * CopyConstructible.
+    * @throws Any exceptions thrown by the copy constructor of the object or
+    * by the allocator, even if another thread executed the request.
+    *
+    * @note This function is Thread-safe, but blocking.
+    */
+    void push_back(const T& t)
+    {
+        execute(PUSH_COPY, const_cast<T*>(&t));
+    }
+
+    /** Push object into the queue by moving it.
+    *
+    * @param t Object you want to push into the queue. Requires T to be
+    * MoveConstructible.
+    * @throws Any exceptions thrown by the move constructor of the object or
+    * by the allocator, even if another thread executed the request.
+    *
+    * @note This function is Thread-safe, but blocking.
+    */
+    void push_back(T&& t)
+    {
+        execute(PUSH_MOVE, &t);
+    }
+
+    /** Pop object from the queue.
+    *
+    * @param t Object the front of the queue is moved to. Left unchanged if
+    * the queue is empty.
+    * @return false if the queue was empty, true otherwise.
+    * @throws Any exceptions thrown by the move assignment of the object.
+    *
+    * @note This function is Thread-safe, but blocking.
+    */
+    bool pop_front(T& t)
+    {
+        return execute(POP, &t);
+    }
+
+    /** Get size of the queue.
+    *
+    * @return Approximation of the current queue size.
+    * @see atomic_queue_base::size()
+    */
+    std::size_t size() const noexcept
+    { return size_.load(std::memory_order_relaxed); }
+
+private:
+    combining_queue(const combining_queue&);
+    combining_queue& operator=(const combining_queue&);
+
+    enum operation { PUSH_COPY, PUSH_MOVE, POP };
+
+    enum slot_state {
+        FREE /**< Not owned by any thread. */,
+        OWNED /**< Owned by a thread, no request. */,
+        PENDING /**< Request published, waiting for a combiner. */,
+        DONE /**< Request executed, result available. */
+    };
+
+    /** A publication slot, one cache line per slot. */
+    struct slot
+    {
+        slot() noexcept
+            : state(FREE), op(POP), value(nullptr), result(false)
+        { }
+
+        char pad0_[64];
+        std::atomic<int> state /**< A slot_state. */;
+        operation op /**< Requested operation. */;
+        T* value /**< Object to push, or to pop into. */;
+        bool result /**< Whether a pop found an element. */;
+        std::exception_ptr error /**< Exception thrown by the request. */;
+        char pad1_[64];
+    };
+
+    bool execute(operation op, T* value)
+    {
+        slot& s = acquire_slot();
+
+        s.op = op;
+        s.value = value;
+        s.state.store(PENDING, std::memory_order_release);
+
+        while (s.state.load(std::memory_order_acquire) != DONE)
+        {
+            if (!combining_.load(std::memory_order_relaxed) &&
+                !combining_.exchange(true, std::memory_order_acquire))
+            {
+                combine();
+                combining_.store(false, std::memory_order_release);
+            }
+            else
+                std::this_thread::yield();
+        }
+
+        bool result = s.result;
+        std::exception_ptr error = std::move(s.error);
+        s.error = nullptr;
+        s.state.store(FREE, std::memory_order_release);
+
+        if (error)
+            std::rethrow_exception(error);
+        return result;
+    }
+
+    slot& acquire_slot() noexcept
+    {
+        // Start at the home slot of this thread. Thread indices are reused
+        // when threads exit, so unless the process has more threads alive at
+        // once than there are slots, nobody else uses it, and the only other
+        // thread that touches its cache line is the combiner.
+        const std::size_t home = this_thread_index();
+
+        for (;;)
+        {
+            for (std::size_t i = 0; i < slot_count_; ++i)
+            {
+                slot& s = slots_[(home + i) % slot_count_];
+                int expected = FREE;
+                if (s.state.load(std::memory_order_relaxed) == FREE &&
+                    s.state.compare_exchange_strong(expected, OWNED,
+                        std::memory_order_acquire))
+                    return s;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    /** Execute pending requests. Must hold the combiner lock. */
+    void combine() noexcept
+    {
+        // A few passes catch the requests that are published while we scan.
+        for (unsigned pass = 0; pass < 3; ++pass)
+        {
+            bool found = false;
+
+            for (std::size_t i = 0; i < slot_count_; ++i)
+            {
+                slot& s = slots_[i];
+                if (s.state.load(std::memory_order_acquire) != PENDING)
+                    continue;
+
+                found = true;
+                try {
+                    switch (s.op)
+                    {
+                    case PUSH_COPY:
+                        queue_.push_back(*static_cast<const T*>(s.value));
+                        break;
+                    case PUSH_MOVE:
+                        queue_.push_back(std::move(*s.value));
+                        break;
+                    case POP:
+                        s.result = !queue_.empty();
+                        if (s.result)
+                        {
+                            *s.value = std::move(queue_.front());
+                            queue_.pop_front();
+                        }
+                        break;
+                    }
+                } catch(...)
+                {
+                    s.error = std::current_exception();
+                }
+
+                s.state.store(DONE, std::memory_order_release);
+            }
+
+            if (!found) break;
+        }
+
+        size_.store(queue_.size(), std::memory_order_relaxed);
+    }
+
+    slot* slots_ /**< Publication slots. */;
+    std::size_t slot_count_ /**< Number of publication slots. */;
+
+    std::deque<T, Allocator> queue_ /**< Sequential queue. */;
+    std::atomic_size_t size_ /**< Size of queue after the last combine. */;
+
+    char pad0_[64];
+    std::atomic<bool> combining_ /**< The combiner lock. */;
+    char pad1_[64];
+};
+
+} // namespace detail
+
+using detail::combining_queue;
+
+} // namespace aq
+
+#endif // ifndef COMBINING_QUEUE_HPP_INCLUDED
@@ -0,0 +1,348 @@
+/*
+* Copyright (c) 2012 Alexander Korsunsky <fat.lobyte9@gmail.com>
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+* 1. Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+* IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+* THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+* PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+* OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+* OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef COMPACT_QUEUE_HPP_INCLUDED
+#define COMPACT_QUEUE_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <memory>
+#include <type_traits>
+#include <atomic>
+
+namespace aq {
+
+namespace detail {
+
+/** A thread-safe and lock-free queue with small nodes.
+*
+* Instead of allocating every node on its own, this queue takes its nodes
+* from a slab of fixed size that is allocated on construction. Nodes are
+* linked by 32 bit indices into the slab, and the other 32 bits of each link
+* hold a tag that is incremented on every change. This makes a node of a
+* compact_queue<int> 16 bytes large, where an atomic_queue_base<int> needs
+* 16 bytes plus the overhead of a separate heap allocation, and the tags make
+* the queue immune to the ABA problem.
+*
+* The algorithm is the one by Michael and Scott, with a free list for the
+* nodes of the slab. Elements are copied out of the queue by pop_front(),
+* before it is known whether the pop succeeds, so T must be trivially
+* copyable.
+*
+* @tparam T Type of the objects this queue will hold.
+* @tparam Allocator Allocator type
+*/
+template <typename T, typename Allocator = std::allocator<T> >
+class compact_queue
+{
+// libstdc++ before GCC 5 doesn't know is_trivially_copyable
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 5
+    static_assert(std::is_trivial<T>::value,
+        "compact_queue requires a trivially copyable value type.");
+#else
+    static_assert(std::is_trivially_copyable<T>::value,
+        "compact_queue requires a trivially copyable value type.");
+#endif
+
+public:
+
+    /** Construct an empty queue.
+    *
+    * @param capacity Maximum number of elements in the queue.
+    * @param alc Allocator object that is to be used for the slab.
+    * @throws std::length_error if capacity is 2^32 - 1 or larger, any
+    * exceptions thrown by the allocator.
+    */
+    explicit compact_queue(
+        std::size_t capacity,
+        const Allocator& alc = Allocator()
+    )
+        : nodes_(nullptr), capacity_(capacity), alc_(alc),
+        size_(0u), head_(0u), tail_(0u), free_(pack(NIL, 0u))
+    {
+        if (capacity_ >= NIL)
+            throw std::length_error("compact_queue capacity too large");
+
+        // one extra node for the dummy the head points to
+        nodes_ = NodeAllocatorTraits::allocate(alc_, capacity_ + 1);
+        for (std::size_t i = 0; i <= capacity_; ++i)
+            NodeAllocatorTraits::construct(alc_, &nodes_[i]);
+
+        nodes_[0].next.store(pack(NIL, 0u), std::memory_order_relaxed);
+        for (std::size_t i = 1; i <= capacity_; ++i)
+            nodes_[i].next.store(
+                pack(i < capacity_ ? index_type(i + 1) : NIL, 0u),
+                std::memory_order_relaxed
+            );
+        if (capacity_)
+            free_.store(pack(1u, 0u), std::memory_order_relaxed);
+    }
+
+    /** Destructor.
+    *
+    * @note The queue is thread-safe before this function is invoked.
+    */
+    ~compact_queue() noexcept
+    {
+        NodeAllocatorTraits::deallocate(alc_, nodes_, capacity_ + 1);
+    }
+
+    /** Push object into the queue by copying it.
+    *
+    * @param t Object you want to push into the queue.
+    * @throws std::bad_alloc if the queue is full.
+    *
+    * @note This function is Thread-safe and lock-free.
+    */
+    void push_back(const T& t)
+    {
+        if (!try_push_back(t))
+            throw std::bad_alloc();
+    }
+
+    /** Push object into the queue by copying it, if there is room.
+    *
+    * @param t Object you want to push into the queue.
+    * @return false if the queue is full, true otherwise.
+    *
+    * @note This function is Thread-safe and lock-free.
+    */
+    bool try_push_back(const T& t) noexcept
+    {
+        const index_type n = allocate_node();
+        if (n == NIL) return false;
+
+        // count the node before linking it, so that a pop_front() of it
+        // can't make the size wrap around
+        ++size_;
+
+        node& new_node = nodes_[n];
+        new_node.t = t;
+        new_node.next.store(
+            pack(NIL, tag_of(new_node.next.load(std::memory_order_relaxed)) + 1),
+            std::memory_order_relaxed
+        );
+
+        for(;;)
+        {
+            tagged_index tail = tail_.load(std::memory_order_acquire);
+            node& tail_node = nodes_[index_of(tail)];
+            tagged_index next = tail_node.next.load(std::memory_order_acquire);
+
+            if (tail != tail_.load(std::memory_order_acquire))
+                continue;
+
+            if (index_of(next) == NIL)
+            {
+                // link the new node behind the last one, then try to swing
+                // the tail. If that fails, someone else helped already.
+                if (tail_node.next.compare_exchange_weak(
+                        next, pack(n, tag_of(next) + 1),
+                        std::memory_order_release, std::memory_order_relaxed))
+                {
+                    tail_.compare_exchange_strong(
+                        tail, pack(n, tag_of(tail) + 1),
+                        std::memory_order_release, std::memory_order_relaxed
+                    );
+                    break;
+                }
+            }
+            else
+                // the tail is lagging behind, help moving it forward
+                tail_.compare_exchange_strong(
+                    tail, pack(index_of(next), tag_of(tail) + 1),
+                    std::memory_order_release, std::memory_order_relaxed
+                );
+        }
+
+        return true;
+    }
+
+    /** Pop object from the queue.
+    *
+    * @param t Object the front of the queue is copied to. Left unchanged if
+    * the queue is empty.
+    * @return false if the queue was empty, true otherwise.
+    *
+    * @note This function is Thread-safe and lock-free.
+    */
+    bool pop_front(T& t) noexcept
+    {
+        for(;;)
+        {
+            tagged_index head = head_.load(std::memory_order_acquire);
+            tagged_index tail = tail_.load(std::memory_order_acquire);
+            tagged_index next =
+                nodes_[index_of(head)].next.load(std::memory_order_acquire);
+
+            if (head != head_.load(std::memory_order_acquire))
+                continue;
+
+            if (index_of(head) == index_of(tail))
+            {
+                if (index_of(next) == NIL)
+                    return false; // nothing to pop
+
+                tail_.compare_exchange_strong(
+                    tail, pack(index_of(next), tag_of(tail) + 1),
+                    std::memory_order_release, std::memory_order_relaxed
+                );
+            }
+            else if (index_of(next) != NIL)
+            {
+                // The value has to be copied before the node is unlinked,
+                // afterwards another thread may recycle it. If the node was
+                // recycled before, the tag of head_ has changed and the
+                // exchange fails.
+                T value = nodes_[index_of(next)].t;
+
+                if (head_.compare_exchange_weak(
+                        head, pack(index_of(next), tag_of(head) + 1),
+                        std::memory_order_acq_rel, std::memory_order_relaxed))
+                {
+                    // the old dummy is free, next is the new dummy
+                    free_node(index_of(head));
+                    --size_;
+                    t = value;
+                    return true;
+                }
+            }
+        }
+    }
+
+    /** Get size of the queue.
+    *
+    * @return Approximation of the current queue size.
+    * @see atomic_queue_base::size()
+    */
+    std::size_t size() const noexcept
+    { return size_; }
+
+    /** Maximum number of elements in the queue. */
+    std::size_t capacity() const noexcept
+    { return capacity_; }
+
+    /** Number of bytes a single element occupies in the slab. */
+    static std::size_t node_size() noexcept
+    { return sizeof(node); }
+
+private:
+    compact_queue(const compact_queue&);
+    compact_queue& operator=(const compact_queue&);
+
+    typedef std::uint32_t index_type;
+
+    /** Index in the lower, tag in the upper 32 bits. */
+    typedef std::uint64_t tagged_index;
+
+    static const index_type NIL = 0xFFFFFFFFu;
+
+    /** A node in the slab. */
+    struct node
+    {
+        std::atomic<tagged_index> next /**< Next node in list. */;
+        T t /**< Value */;
+    };
+
+    static tagged_index pack(index_type idx, index_type tag) noexcept
+    { return tagged_index(tag) << 32 | idx; }
+
+    static index_type index_of(tagged_index v) noexcept
+    { return index_type(v); }
+
+    static index_type tag_of(tagged_index v) noexcept
+    { return index_type(v >> 32); }
+
+    /** Take a node from the free list. Returns NIL if there is none. */
+    index_type allocate_node() noexcept
+    {
+        tagged_index top = free_.load(std::memory_order_acquire);
+
+        for(;;)
+        {
+            index_type n = index_of(top);
+            if (n == NIL) return NIL;
+
+            index_type below =
+                index_of(nodes_[n].next.load(std::memory_order_relaxed));
+            if (free_.compare_exchange_weak(
+                    top, pack(below, tag_of(top) + 1),
+                    std::memory_order_acquire, std::memory_order_acquire))
+                return n;
+        }
+    }
+
+    /** Put a node on the free list. */
+    void free_node(index_type n) noexcept
+    {
+        node& freed = nodes_[n];
+        const index_type tag =
+            tag_of(freed.next.load(std::memory_order_relaxed)) + 1;
+        tagged_index top = free_.load(std::memory_order_relaxed);
+
+        do {
+            // bumping the tag makes late exchanges on this node fail
+            freed.next.store(
+                pack(index_of(top), tag), std::memory_order_relaxed
+            );
+        } while(!free_.compare_exchange_weak(
+            top, pack(n, tag_of(top) + 1),
+            std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    typedef std::allocator_traits<Allocator> ValueAllocatorTraits;
+
+    // Rebind allocator traits for Allocator to our own node type
+    typedef
+        typename ValueAllocatorTraits::template rebind_traits<node>
+        NodeAllocatorTraits;
+
+    node* nodes_ /**< The slab. */;
+    std::size_t capacity_ /**< Number of nodes in the slab, minus one. */;
+    typename NodeAllocatorTraits::allocator_type alc_ /**< Slab allocator. */;
+
+    std::atomic_size_t size_ /**< Current size of queue. Not reliable. */;
+
+    // keep front, back and free list on separate cache lines
+    char pad0_[64];
+    std::atomic<tagged_index> head_ /**< Dummy before the front. */;
+    char pad1_[64 - sizeof(std::atomic<tagged_index>)];
+    std::atomic<tagged_index> tail_ /**< Back of the queue. */;
+    char pad2_[64 - sizeof(std::atomic<tagged_index>)];
+    std::atomic<tagged_index> free_ /**< Top of the free list. */;
+    char pad3_[64 - sizeof(std::atomic<tagged_index>)];
+};
+
+} // namespace detail
+
+using detail::compact_queue;
+
+} // namespace aq
+
+#endif // ifndef COMPACT_QUEUE_HPP_INCLUDED
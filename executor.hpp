@@ -0,0 +1,598 @@
+/*
+* Copyright (c) 2012 Alexander Korsunsky <fat.lobyte9@gmail.com>
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+* 1. Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+* IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+* THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+* PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+* OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+* OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef EXECUTOR_HPP_INCLUDED
+#define EXECUTOR_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+namespace aq {
+
+namespace detail {
+
+/** Table of type-erased operations on a callable stored in a task. */
+struct task_ops
+{
+    void (*invoke)(void* storage);
+    void (*move)(void* from, void* to);
+    void (*destroy)(void* storage);
+};
+
+/** Operations for callables that live directly in the inline buffer. */
+template <typename F>
+struct inline_task_ops
+{
+    static void invoke(void* storage)
+    { (*static_cast<F*>(storage))(); }
+
+    static void move(void* from, void* to)
+    {
+        ::new(to) F(std::move(*static_cast<F*>(from)));
+        static_cast<F*>(from)->~F();
+    }
+
+    static void destroy(void* storage)
+    { static_cast<F*>(storage)->~F(); }
+
+    static const task_ops table;
+};
+
+template <typename F>
+const task_ops inline_task_ops<F>::table = {
+    &inline_task_ops<F>::invoke,
+    &inline_task_ops<F>::move,
+    &inline_task_ops<F>::destroy
+};
+
+/** Operations for oversized callables. The inline buffer holds an F*. */
+template <typename F>
+struct heap_task_ops
+{
+    static void invoke(void* storage)
+    { (**static_cast<F**>(storage))(); }
+
+    static void move(void* from, void* to)
+    { ::new(to) F*(*static_cast<F**>(from)); }
+
+    static void destroy(void* storage)
+    { delete *static_cast<F**>(storage); }
+
+    static const task_ops table;
+};
+
+template <typename F>
+const task_ops heap_task_ops<F>::table = {
+    &heap_task_ops<F>::invoke,
+    &heap_task_ops<F>::move,
+    &heap_task_ops<F>::destroy
+};
+
+
+/** A move-only callable with signature void().
+*
+* Unlike std::function, this class does not require the callable to be
+* CopyConstructible, and it stores callables of up to InlineSize bytes
+* directly inside the object. Only callables that are larger than that, that
+* require a stricter alignment or that may throw when moved are allocated on
+* the heap.
+*
+* @tparam InlineSize Size of the inline buffer in bytes.
+*/
+template <std::size_t InlineSize>
+class basic_task
+{
+    // Pointer alignment keeps the task at InlineSize plus one pointer, so
+    // that it packs tightly into the slots of an executor ring.
+    typedef typename std::aligned_storage<
+        InlineSize, std::alignment_of<void*>::value
+    >::type storage_type;
+
+    static_assert(InlineSize >= sizeof(void*),
+        "The inline buffer must be able to hold at least a pointer.");
+
+public:
+
+    /** Whether a callable of type F will be stored without allocation. */
+    template <typename F>
+    struct stores_inline
+        : std::integral_constant<bool,
+            sizeof(F) <= sizeof(storage_type) &&
+            std::alignment_of<F>::value <=
+                std::alignment_of<storage_type>::value &&
+            std::is_nothrow_move_constructible<F>::value
+        >
+    { };
+
+    /** Construct an empty task. */
+    basic_task() noexcept
+        : ops_(nullptr)
+    { }
+
+    /** Construct a task from a callable.
+    *
+    * @param f Callable object. Requires F to be MoveConstructible.
+    * @throws Any exceptions thrown by the constructor of F, std::bad_alloc
+    * if F does not fit into the inline buffer and allocation fails.
+    */
+    template <typename F, typename = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, basic_task>::value
+    >::type>
+    basic_task(F&& f)
+        : ops_(nullptr)
+    {
+        typedef typename std::decay<F>::type callable_type;
+        construct<callable_type>(
+            std::forward<F>(f), stores_inline<callable_type>()
+        );
+    }
+
+    basic_task(basic_task&& other) noexcept
+        : ops_(other.ops_)
+    {
+        if (ops_)
+        {
+            ops_->move(&other.storage_, &storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    basic_task& operator=(basic_task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            if (other.ops_)
+            {
+                other.ops_->move(&other.storage_, &storage_);
+                ops_ = other.ops_;
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    ~basic_task() noexcept
+    { reset(); }
+
+    /** Invoke the stored callable. The task must not be empty. */
+    void operator()()
+    { ops_->invoke(&storage_); }
+
+    /** Destroy the stored callable, leaving the task empty. */
+    void reset() noexcept
+    {
+        if (ops_)
+        {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    explicit operator bool() const noexcept
+    { return ops_ != nullptr; }
+
+private:
+    basic_task(const basic_task&);
+    basic_task& operator=(const basic_task&);
+
+    template <typename C, typename F>
+    void construct(F&& f, std::true_type /* inline */)
+    {
+        ::new(static_cast<void*>(&storage_)) C(std::forward<F>(f));
+        ops_ = &inline_task_ops<C>::table;
+    }
+
+    template <typename C, typename F>
+    void construct(F&& f, std::false_type /* inline */)
+    {
+        ::new(static_cast<void*>(&storage_)) C*(new C(std::forward<F>(f)));
+        ops_ = &heap_task_ops<C>::table;
+    }
+
+    storage_type storage_ /**< Callable, or pointer to it. */;
+    const task_ops* ops_ /**< Operations for the stored type, or null. */;
+};
+
+
+/** A thread pool that runs tasks submitted through a lock-free queue.
+*
+* Tasks are stored as basic_task<InlineSize> objects in a preallocated ring
+* of slots, so submitting a callable that fits into the inline buffer does
+* not allocate. Tasks are started in the order they were submitted.
+*
+* If the ring is full, the submitting thread does not wait idly, but takes
+* tasks from the front of the ring and runs them itself until its own task
+* fits. This also means that submit() may run other tasks before returning,
+* which must be kept in mind when calling it while holding a lock.
+*
+* Worker threads take up to a batch of tasks at once and park on a
+* condition variable when there is nothing to do. Submitting threads only
+* touch the condition variable if any worker is actually parked.
+*
+* Tasks must not throw; an exception escaping a task calls std::terminate(),
+* just as it would in a std::thread.
+*
+* @tparam InlineSize Size of the inline buffer of each task in bytes. The
+* default makes one ring slot 64 bytes large on 64 bit platforms. The ring
+* starts on a cache line boundary, so every slot occupies exactly one line.
+*/
+template <std::size_t InlineSize = 48>
+class basic_executor
+{
+public:
+    typedef basic_task<InlineSize> task_type;
+
+    /** Start the worker threads.
+    *
+    * @param threads Number of worker threads. If zero, the number of hardware
+    * threads is used.
+    * @param capacity Number of slots in the ring. Rounded up to a power of
+    * two.
+    * @param batch Maximum number of tasks a worker takes at once.
+    * @throws std::bad_alloc, std::system_error
+    */
+    explicit basic_executor(
+        std::size_t threads = 0,
+        std::size_t capacity = 1024,
+        std::size_t batch = 8
+    )
+        : ring_(nullptr), slots_(nullptr), batches_(nullptr), mask_(0),
+        batch_(batch ? batch : 1),
+        enqueue_pos_(0), dequeue_pos_(0), sleepers_(0), stop_(false)
+    {
+        std::size_t cap = 2;
+        while (cap < capacity)
+            cap <<= 1;
+
+        // new[] doesn't align to cache lines, so align the ring by hand
+        ring_ = new char[cap * sizeof(slot) + cache_line - 1];
+        slots_ = reinterpret_cast<slot*>(
+            (reinterpret_cast<std::uintptr_t>(ring_) + cache_line - 1) /
+            cache_line * cache_line
+        );
+        mask_ = cap - 1;
+        for (std::size_t i = 0; i < cap; ++i)
+        {
+            ::new(static_cast<void*>(&slots_[i])) slot;
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        if (!threads)
+            threads = std::thread::hardware_concurrency();
+        if (!threads)
+            threads = 1;
+
+        try {
+            // the workers' batch buffers are allocated up front, so that
+            // running tasks does not allocate either
+            batches_ = new task_type[threads * batch_];
+            workers_.reserve(threads);
+            for (std::size_t i = 0; i < threads; ++i)
+                workers_.push_back(std::thread(
+                    &basic_executor::run, this, &batches_[i * batch_]
+                ));
+        } catch(...)
+        {
+            shutdown();
+            delete[] batches_;
+            destroy_ring();
+            throw;
+        }
+    }
+
+    /** Destructor.
+    *
+    * Runs all tasks that were submitted before, then joins the workers.
+    */
+    ~basic_executor() noexcept
+    {
+        shutdown();
+        delete[] batches_;
+        destroy_ring();
+    }
+
+    /** Submit a callable for execution.
+    *
+    * @param f Callable object with signature void(). Requires F to be
+    * MoveConstructible.
+    * @throws Any exceptions thrown by the constructor of F. std::bad_alloc if
+    * the callable does not fit inline and allocation fails.
+    *
+    * @note This function is Thread-safe. It does not allocate if
+    * task_type::stores_inline<F> holds.
+    */
+    template <typename F>
+    void submit(F&& f)
+    {
+        task_type t(std::forward<F>(f));
+        push(t);
+        wake(1);
+    }
+
+    /** Submit a range of callables for execution.
+    *
+    * The callables are moved out of the range. All of them are enqueued
+    * before any parked worker is woken up, so fanning out n tasks costs one
+    * wake-up instead of n.
+    *
+    * @param first, last Range of callable objects with signature void().
+    * @throws Any exceptions thrown by the constructor of the callables. Tasks
+    * that were enqueued before the exception are still executed.
+    *
+    * @note This function is Thread-safe.
+    */
+    template <typename InputIt>
+    void submit_bulk(InputIt first, InputIt last)
+    {
+        std::size_t n = 0;
+
+        try {
+            for (; first != last; ++first, ++n)
+            {
+                task_type t(std::move(*first));
+                push(t);
+            }
+        } catch(...)
+        {
+            wake(n);
+            throw;
+        }
+        wake(n);
+    }
+
+    /** Number of worker threads. */
+    std::size_t concurrency() const noexcept
+    { return workers_.size(); }
+
+private:
+    basic_executor(const basic_executor&);
+    basic_executor& operator=(const basic_executor&);
+
+    /** A ring slot. seq tells whether the slot is free or holds a task. */
+    struct slot
+    {
+        std::atomic<std::size_t> seq;
+        task_type task;
+    };
+
+    static const std::size_t cache_line = 64;
+
+    static_assert(InlineSize != 48 || sizeof(void*) != 8 ||
+        sizeof(slot) == cache_line,
+        "A slot of the default executor must fill one cache line.");
+
+    void destroy_ring() noexcept
+    {
+        for (std::size_t i = 0; i <= mask_; ++i)
+            slots_[i].~slot();
+        delete[] ring_;
+    }
+
+    // Tasks must not throw. The workers run them in their own threads
+    // anyway, but a submitter that helps out must not pass an exception on
+    // to its caller and lose its own task either.
+    static void run_task(task_type& t) noexcept
+    {
+        t();
+        t.reset();
+    }
+
+    void push(task_type& t)
+    {
+        while (!try_enqueue(t))
+        {
+            // The ring is full: make sure nobody sleeps on it and help
+            // draining it.
+            wake(2);
+
+            task_type other;
+            if (try_dequeue(other))
+                run_task(other);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    bool try_enqueue(task_type& t) noexcept
+    {
+        std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        slot* s;
+
+        for (;;)
+        {
+            s = &slots_[pos & mask_];
+            std::size_t seq = s->seq.load(std::memory_order_acquire);
+            std::ptrdiff_t dif =
+                static_cast<std::ptrdiff_t>(seq) -
+                static_cast<std::ptrdiff_t>(pos);
+
+            if (dif == 0)
+            {
+                if (enqueue_pos_.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+                return false; // ring is full
+            else
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+
+        s->task = std::move(t);
+        s->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_dequeue(task_type& t) noexcept
+    {
+        std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        slot* s;
+
+        for (;;)
+        {
+            s = &slots_[pos & mask_];
+            std::size_t seq = s->seq.load(std::memory_order_acquire);
+            std::ptrdiff_t dif =
+                static_cast<std::ptrdiff_t>(seq) -
+                static_cast<std::ptrdiff_t>(pos + 1);
+
+            if (dif == 0)
+            {
+                if (dequeue_pos_.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+                return false; // ring is empty
+            else
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+        }
+
+        t = std::move(s->task);
+        s->seq.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool has_work() const noexcept
+    {
+        std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        return slots_[pos & mask_].seq.load(std::memory_order_acquire) ==
+            pos + 1;
+    }
+
+    void wake(std::size_t n)
+    {
+        if (!n) return;
+
+        // Pairs with the fence in park(): either the worker sees the new
+        // task, or we see the worker in sleepers_.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!sleepers_.load(std::memory_order_relaxed)) return;
+
+        std::lock_guard<std::mutex> lk(park_mtx_);
+        if (n == 1)
+            park_cv_.notify_one();
+        else
+            park_cv_.notify_all();
+    }
+
+    /** Block until there is work. Returns false if the worker should exit. */
+    bool park()
+    {
+        std::unique_lock<std::mutex> lk(park_mtx_);
+
+        sleepers_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        while (!has_work() && !stop_.load())
+            park_cv_.wait(lk);
+
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+
+        // another worker may have taken the task already, so only leave once
+        // the executor is stopping and drained
+        return !stop_.load() || has_work();
+    }
+
+    void run(task_type* batch)
+    {
+        for (;;)
+        {
+            std::size_t n = 0;
+            while (n < batch_ && try_dequeue(batch[n]))
+                ++n;
+
+            if (n)
+            {
+                for (std::size_t i = 0; i < n; ++i)
+                    run_task(batch[i]);
+                continue;
+            }
+
+            // Give submitters a short chance before going to sleep.
+            for (unsigned spin = 0; spin < 16 && !has_work(); ++spin)
+                std::this_thread::yield();
+
+            if (!has_work() && !park())
+                return;
+        }
+    }
+
+    void shutdown() noexcept
+    {
+        {
+            std::lock_guard<std::mutex> lk(park_mtx_);
+            stop_.store(true);
+            park_cv_.notify_all();
+        }
+
+        for (auto& w: workers_)
+            w.join();
+        workers_.clear();
+    }
+
+    char* ring_ /**< Memory of the ring. */;
+    slot* slots_ /**< Ring of task slots, aligned to a cache line. */;
+    task_type* batches_ /**< Batch buffers of all workers. */;
+    std::size_t mask_ /**< Number of slots minus one. */;
+    std::size_t batch_ /**< Maximum number of tasks a worker takes at once. */;
+
+    // keep the producer and consumer positions on separate cache lines
+    char pad0_[64];
+    std::atomic<std::size_t> enqueue_pos_ /**< Next slot to fill. */;
+    char pad1_[64 - sizeof(std::atomic<std::size_t>)];
+    std::atomic<std::size_t> dequeue_pos_ /**< Next slot to drain. */;
+    char pad2_[64 - sizeof(std::atomic<std::size_t>)];
+
+    std::atomic<unsigned> sleepers_ /**< Number of parked workers. */;
+    std::atomic<bool> stop_ /**< Set by the destructor. */;
+    std::mutex park_mtx_;
+    std::condition_variable park_cv_;
+    std::vector<std::thread> workers_;
+};
+
+} // namespace detail
+
+using detail::basic_task;
+using detail::basic_executor;
+
+/** Executor with the default inline buffer size. */
+typedef basic_executor<> executor;
+
+} // namespace aq
+
+#endif // ifndef EXECUTOR_HPP_INCLUDED
@@ -0,0 +1,171 @@
+#include "arena_allocator.hpp"
+#include "atomic_queue.hpp"
+
+#include <cstddef>
+#include <set>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include "testutils.hpp"
+
+DECLARE_TEST("arena_allocator Allocation and destruction")
+
+
+#ifndef MULTITEST_THREADCOUNT
+#    define MULTITEST_THREADCOUNT 8
+#endif
+
+#ifndef MULTITEST_ROUNDCOUNT
+#    define MULTITEST_ROUNDCOUNT 1000
+#endif
+
+#ifndef MULTITEST_BATCHSIZE
+#    define MULTITEST_BATCHSIZE 64
+#endif
+
+#ifndef ARENATEST_PUSHCOUNT
+#    define ARENATEST_PUSHCOUNT 300000
+#endif
+
+struct Obj {
+    explicit Obj(std::size_t* ccounter)
+        : construct_counter_(ccounter)
+    {
+        ++*construct_counter_;
+    }
+
+    Obj(const Obj& other)
+        : construct_counter_(other.construct_counter_)
+    {
+        ++*construct_counter_;
+    }
+
+    ~Obj()
+    {
+        --*construct_counter_;
+    }
+
+private:
+    std::size_t* construct_counter_;
+};
+
+
+int main()
+{
+    std::cout<<"\n--- Allocating and reusing blocks ---\n";
+    {
+        aq::arena_allocator<int> alc;
+        TEST_ASSERT(alc.reserved() == 0);
+
+        int* p = alc.allocate(1);
+        TEST_ASSERT(alc.reserved() == aq::detail::arena::huge_page_size);
+        TEST_ASSERT(reinterpret_cast<std::size_t>(p) % 16 == 0);
+        alc.deallocate(p, 1);
+        TEST_ASSERT(alc.allocate(1) == p);
+
+        // rebound copies share the arena
+        aq::arena_allocator<double> dalc(alc);
+        TEST_ASSERT(dalc == alc);
+        TEST_ASSERT(aq::arena_allocator<int>() != alc);
+        double* d = dalc.allocate(1);
+        TEST_ASSERT(static_cast<void*>(d) != static_cast<void*>(p));
+        dalc.deallocate(d, 1);
+
+        // large blocks are not taken from the chunks
+        int* large = alc.allocate(1000);
+        large[999] = 5;
+        alc.deallocate(large, 1000);
+        TEST_ASSERT(alc.reserved() == aq::detail::arena::huge_page_size);
+    }
+
+    std::cout<<"\n--- Pushing and popping, reusing nodes ---\n";
+    {
+        typedef aq::atomic_queue_base<int, aq::arena_allocator<int> > queue;
+        aq::arena_allocator<int> alc;
+        queue q(alc);
+
+        for (int round = 0; round < 3; ++round)
+        {
+            for (int i = 0; i < ARENATEST_PUSHCOUNT; ++i)
+                q.push_back(i);
+            for (int i = 0; i < ARENATEST_PUSHCOUNT; ++i)
+            {
+                int* p = q.pop_front();
+                TEST_ASSERT(p && *p == i);
+                q.deallocate(p);
+            }
+        }
+
+        // the nodes of the first round, spread over several chunks, were
+        // reused by the others
+        std::size_t reserved = alc.reserved();
+        TEST_ASSERT(reserved > aq::detail::arena::huge_page_size);
+        for (int i = 0; i < ARENATEST_PUSHCOUNT; ++i)
+            q.push_back(i);
+        TEST_ASSERT(alc.reserved() == reserved);
+    }
+
+    std::cout<<"\n--- Destructing queues with remaining elements ---\n";
+    {
+        std::size_t construct_counter = 0;
+        {
+            aq::atomic_queue_base<Obj, aq::arena_allocator<Obj> > q;
+            for (int i = 0; i < ARENATEST_PUSHCOUNT; ++i)
+                q.push_back(Obj(&construct_counter));
+            TEST_ASSERT(construct_counter == ARENATEST_PUSHCOUNT);
+        }
+        // destructors still run, only the deallocation is skipped
+        TEST_ASSERT(construct_counter == 0);
+
+        aq::atomic_queue_base<long, aq::arena_allocator<long> > q;
+        for (long i = 0; i < ARENATEST_PUSHCOUNT; ++i)
+            q.push_back(i);
+    }
+
+    std::cout<<"\n--- Multithreaded allocation and deallocation ---\n";
+    {
+        aq::arena_allocator<std::size_t> alc;
+        std::vector<std::thread> threadvec;
+
+        for (std::size_t ti = 0; ti < MULTITEST_THREADCOUNT; ++ti)
+            threadvec.push_back(std::thread(
+            [ti, alc]() mutable {
+                std::vector<std::size_t*> blocks(MULTITEST_BATCHSIZE);
+
+                for (unsigned ri = 0; ri < MULTITEST_ROUNDCOUNT; ++ri)
+                {
+                    for (auto& b: blocks)
+                    {
+                        b = alc.allocate(2);
+                        b[0] = ti;
+                        b[1] = ri;
+                    }
+
+                    // nobody else got the same block in the meantime
+                    for (auto b: blocks)
+                    {
+                        TEST_ASSERT(b[0] == ti && b[1] == ri);
+                        alc.deallocate(b, 2);
+                    }
+                }
+            }
+            ));
+
+        for (auto& t: threadvec)
+            t.join();
+
+        // everything was given back, so no block is handed out twice
+        std::set<std::size_t*> seen;
+        std::vector<std::size_t*> blocks;
+        for (std::size_t i = 0; i < MULTITEST_THREADCOUNT * MULTITEST_BATCHSIZE; ++i)
+        {
+            blocks.push_back(alc.allocate(2));
+            TEST_ASSERT(seen.insert(blocks.back()).second);
+        }
+        for (auto b: blocks)
+            alc.deallocate(b, 2);
+    }
+
+    return CONCLUDE_TEST();
+}
@@ -0,0 +1,127 @@
+#include "atomic_queue.hpp"
+
+#include <vector>
+#include <iostream>
+
+#include "testutils.hpp"
+
+DECLARE_TEST("base trivial values and ranges")
+
+
+struct Pod {
+    int id_;
+    double data_;
+};
+
+struct Obj {
+    std::size_t idx_;
+    std::size_t* construct_counter_;
+
+    Obj(std::size_t idx, std::size_t* ccounter)
+        : idx_(idx), construct_counter_(ccounter)
+    { ++*construct_counter_; }
+
+    Obj(const Obj& other)
+        : idx_(other.idx_), construct_counter_(other.construct_counter_)
+    {
+        if (idx_ == THROWING_IDX) throw idx_;
+        ++*construct_counter_;
+    }
+
+    ~Obj()
+    { --*construct_counter_; }
+
+    static const std::size_t THROWING_IDX = 3;
+};
+
+
+const std::size_t NUM_PUSHES = 0xFF;
+
+int main()
+{
+    static_assert(aq::detail::is_trivial_value<int, std::allocator<int> >::value,
+        "int should be handled as a trivial value");
+    static_assert(aq::detail::is_trivial_value<Pod, std::allocator<Pod> >::value,
+        "Pod should be handled as a trivial value");
+    static_assert(!aq::detail::is_trivial_value<Obj, std::allocator<Obj> >::value,
+        "Obj should not be handled as a trivial value");
+
+    std::cout<<"\n--- Pushing single trivial values ---\n";
+    aq::atomic_queue_base<Pod> ap;
+
+    Pod pod = { 1, 1.5 };
+    ap.push_back(pod);
+    ap.push_back(Pod());
+#if !(defined(_MSC_VER) && _MSC_VER <= 1700)
+    ap.emplace_back(pod);
+#endif
+
+    Pod* pp = ap.pop_front();
+    TEST_ASSERT(pp->id_ == 1 && pp->data_ == 1.5); ap.deallocate(pp);
+    pp = ap.pop_front();
+    TEST_ASSERT(pp->id_ == 0 && pp->data_ == 0.0); ap.deallocate(pp);
+#if !(defined(_MSC_VER) && _MSC_VER <= 1700)
+    pp = ap.pop_front();
+    TEST_ASSERT(pp->id_ == 1 && pp->data_ == 1.5); ap.deallocate(pp);
+#endif
+    TEST_ASSERT(ap.pop_front() == nullptr);
+
+    std::cout<<"\n--- Pushing a range of trivial values ---\n";
+    aq::atomic_queue_base<int> ai;
+    std::vector<int> values;
+    for (std::size_t i = 0; i < NUM_PUSHES; ++i)
+        values.push_back(static_cast<int>(i));
+
+    ai.push_back(-1);
+    ai.push_back(values.begin(), values.end());
+    ai.push_back(values.end(), values.end());
+    TEST_ASSERT(ai.size() == NUM_PUSHES + 1);
+
+    int* ip = ai.pop_front();
+    TEST_ASSERT(*ip == -1); ai.deallocate(ip);
+    for (std::size_t i = 0; i < NUM_PUSHES; ++i)
+    {
+        ip = ai.pop_front();
+        TEST_ASSERT(ip && *ip == static_cast<int>(i));
+        ai.deallocate(ip);
+    }
+    TEST_ASSERT(ai.pop_front() == nullptr);
+
+    // leave some values in the queue for the destructor
+    ai.push_back(values.begin(), values.end());
+
+    std::cout<<"\n--- Pushing a range that throws ---\n";
+    std::size_t construct_counter = 0;
+    {
+        std::vector<Obj> objs;
+        objs.reserve(Obj::THROWING_IDX + 1);
+        for (std::size_t i = 0; i <= Obj::THROWING_IDX; ++i)
+            objs.emplace_back(i, &construct_counter);
+
+        aq::atomic_queue_base<Obj> ao;
+        ao.push_back(objs.begin(), objs.begin() + Obj::THROWING_IDX);
+        TEST_ASSERT(ao.size() == Obj::THROWING_IDX);
+
+        try {
+            ao.push_back(objs.begin(), objs.end());
+            TEST_ASSERT(false);
+        }
+        catch(std::size_t)
+        {
+            std::cout<<"Caught exception. Hope everyone is still ok!\n";
+        }
+        TEST_ASSERT(ao.size() == Obj::THROWING_IDX);
+        TEST_ASSERT(construct_counter == objs.size() + Obj::THROWING_IDX);
+
+        for (std::size_t i = 0; i < Obj::THROWING_IDX; ++i)
+        {
+            Obj* op = ao.pop_front();
+            TEST_ASSERT(op && op->idx_ == i);
+            ao.deallocate(op);
+        }
+        TEST_ASSERT(ao.pop_front() == nullptr);
+    }
+    TEST_ASSERT(construct_counter == 0);
+
+    return CONCLUDE_TEST();
+}
@@ -0,0 +1,143 @@
+#include "bounded_queue.hpp"
+
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include "testutils.hpp"
+
+DECLARE_TEST("bounded_queue Push/Pop operations")
+
+
+#ifndef MULTITEST_THREADCOUNT
+#    define MULTITEST_THREADCOUNT 16
+#endif
+
+#ifndef MULTITEST_PUSHCOUNT
+#    define MULTITEST_PUSHCOUNT 1024
+#endif
+
+#ifndef MULTITEST_CAPACITY
+#    define MULTITEST_CAPACITY 32
+#endif
+
+struct Obj {
+    unsigned id_;
+    unsigned idx_;
+};
+
+int main()
+{
+    std::cout<<"\n--- Filling up the queue ---\n";
+    {
+        aq::bounded_queue<int> bq(4);
+        TEST_ASSERT(bq.capacity() == 4);
+
+        for (int i = 0; i < 4; ++i)
+            TEST_ASSERT(bq.try_push_back(i));
+        TEST_ASSERT(!bq.try_push_back(4));
+        TEST_ASSERT(bq.size() == 4);
+
+        // room is only made by deallocate()
+        int* p = bq.pop_front();
+        TEST_ASSERT(*p == 0);
+        TEST_ASSERT(!bq.try_push_back(4));
+        bq.deallocate(p);
+        TEST_ASSERT(bq.try_push_back(4));
+        TEST_ASSERT(!bq.try_push_back(5));
+
+        // leave the rest for the destructor
+    }
+
+    std::cout<<"\n--- Byte budget ---\n";
+    {
+        aq::bounded_queue<int> bq(
+            aq::byte_budget(3 * sizeof(aq::detail::node<int>) + 1)
+        );
+        TEST_ASSERT(bq.capacity() == 3);
+    }
+
+    std::cout<<"\n--- Pushing through a producer ---\n";
+    {
+        aq::bounded_queue<int> bq(5);
+        {
+            aq::bounded_queue<int>::producer p(bq, 2);
+
+            // the producer holds a second credit after the first push
+            TEST_ASSERT(p.try_push_back(0));
+            for (int i = 1; i < 4; ++i)
+                TEST_ASSERT(bq.try_push_back(i));
+            TEST_ASSERT(!bq.try_push_back(4));
+            TEST_ASSERT(p.try_push_back(4));
+            TEST_ASSERT(!p.try_push_back(5));
+
+            int* ip;
+            for (int i = 0; i < 2; ++i)
+            {
+                ip = bq.pop_front();
+                TEST_ASSERT(*ip == i);
+                bq.deallocate(ip);
+            }
+
+            p.push_back_wait(5);
+            TEST_ASSERT(bq.size() == 4);
+        }
+
+        // the unused credit is back
+        TEST_ASSERT(bq.try_push_back(6));
+        TEST_ASSERT(!bq.try_push_back(7));
+    }
+
+    std::cout<<"\n--- Launching threads for simultanous push and pop ---\n";
+    aq::bounded_queue<Obj> bq(MULTITEST_CAPACITY);
+    std::vector<std::thread> threadvec;
+
+    for(unsigned ti = 0; ti < MULTITEST_THREADCOUNT; ++ti)
+        threadvec.push_back(std::thread(
+        [&bq, ti]{
+            // half of the threads push through a producer
+            if (ti % 2)
+            {
+                aq::bounded_queue<Obj>::producer p(bq);
+                for(unsigned oi = 0; oi < MULTITEST_PUSHCOUNT; ++oi)
+                    p.push_back_wait(Obj{ti, oi});
+            }
+            else
+                for(unsigned oi = 0; oi < MULTITEST_PUSHCOUNT; ++oi)
+                    bq.push_back_wait(Obj{ti, oi});
+            std::cout<<'#';
+        }
+        ));
+
+    // Pop and deallocate while the pushers are running. The elements of every
+    // thread must come out in order, and the queue must never hold more than
+    // its capacity.
+    std::vector<unsigned> next_idx(MULTITEST_THREADCOUNT, 0);
+    std::size_t popcount = 0;
+    while (popcount != MULTITEST_PUSHCOUNT * MULTITEST_THREADCOUNT)
+    {
+        TEST_ASSERT(bq.size() <= MULTITEST_CAPACITY);
+
+        Obj* p = bq.pop_front();
+        if (!p)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        TEST_ASSERT(p->id_ < MULTITEST_THREADCOUNT);
+        TEST_ASSERT(p->idx_ == next_idx[p->id_]++);
+        bq.deallocate(p);
+        ++popcount;
+    }
+
+    for(auto& t: threadvec)
+        t.join();
+
+    std::cout<<"\n --- All threads joined ---\n";
+
+    TEST_ASSERT(bq.size() == 0);
+    TEST_ASSERT(bq.pop_front() == nullptr);
+
+    return CONCLUDE_TEST();
+}
@@ -0,0 +1,137 @@
+#include "broadcast_queue.hpp"
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include "testutils.hpp"
+
+DECLARE_TEST("broadcast_queue Push/Consume operations")
+
+
+#ifndef MULTITEST_PUSHCOUNT
+#    define MULTITEST_PUSHCOUNT 100000
+#endif
+
+struct Obj {
+    std::size_t idx_;
+    std::size_t* construct_counter_;
+
+    Obj(std::size_t idx, std::size_t* ccounter)
+        : idx_(idx), construct_counter_(ccounter)
+    { ++*construct_counter_; }
+
+    Obj(const Obj& other)
+        : idx_(other.idx_), construct_counter_(other.construct_counter_)
+    { ++*construct_counter_; }
+
+    ~Obj()
+    { --*construct_counter_; }
+};
+
+
+int main()
+{
+    std::cout<<"\n--- Single threaded push and consume ---\n";
+    std::size_t construct_counter = 0;
+    {
+        aq::broadcast_queue<Obj> bq(3);
+        TEST_ASSERT(bq.capacity() == 4);
+
+        aq::broadcast_queue<Obj>::consumer a = bq.add_consumer();
+        aq::broadcast_queue<Obj>::consumer b = bq.add_consumer({a});
+
+        std::size_t expected_a = 0, expected_b = 0;
+        auto check_a = [&](const Obj& o){ TEST_ASSERT(o.idx_ == expected_a++); };
+        auto check_b = [&](const Obj& o){ TEST_ASSERT(o.idx_ == expected_b++); };
+
+        for (std::size_t idx = 0; idx < 4; ++idx)
+            TEST_ASSERT(bq.try_push_back(Obj(idx, &construct_counter)));
+        TEST_ASSERT(!bq.try_push_back(Obj(4, &construct_counter)));
+
+        // b must wait for a
+        TEST_ASSERT(bq.consume(b, check_b) == 0);
+        TEST_ASSERT(bq.consume(a, check_a, 3) == 3);
+        TEST_ASSERT(!bq.try_push_back(Obj(4, &construct_counter)));
+        TEST_ASSERT(bq.consume(b, check_b) == 3);
+        TEST_ASSERT(bq.try_push_back(Obj(4, &construct_counter)));
+        TEST_ASSERT(bq.consume(a, check_a) == 2);
+        TEST_ASSERT(bq.consume(b, check_b) == 2);
+        TEST_ASSERT(bq.consume(a, check_a) == 0);
+
+        bq.emplace_back(5u, &construct_counter);
+        TEST_ASSERT(construct_counter == 4);
+
+        // late consumers would start ahead of their dependencies
+        bool thrown = false;
+        try {
+            bq.add_consumer({a});
+        } catch(std::logic_error&)
+        {
+            thrown = true;
+        }
+        TEST_ASSERT(thrown);
+    }
+    TEST_ASSERT(construct_counter == 0);
+
+    std::cout<<"\n--- Launching journaler, replicator and metrics threads ---\n";
+    aq::broadcast_queue<std::size_t> bq(64);
+    aq::broadcast_queue<std::size_t>::consumer journaler = bq.add_consumer();
+    aq::broadcast_queue<std::size_t>::consumer replicator = bq.add_consumer();
+    aq::broadcast_queue<std::size_t>::consumer metrics =
+        bq.add_consumer({journaler, replicator});
+
+    std::atomic<std::size_t> journaled(0), replicated(0);
+    std::vector<std::thread> threadvec;
+
+    threadvec.push_back(std::thread(
+    [&]{
+        std::size_t expected = 0;
+        while (expected != MULTITEST_PUSHCOUNT)
+            if (!bq.consume(journaler, [&](std::size_t v){
+                TEST_ASSERT(v == expected++);
+                ++journaled;
+            }))
+                std::this_thread::yield();
+    }
+    ));
+
+    threadvec.push_back(std::thread(
+    [&]{
+        std::size_t expected = 0;
+        while (expected != MULTITEST_PUSHCOUNT)
+            if (!bq.consume(replicator, [&](std::size_t v){
+                TEST_ASSERT(v == expected++);
+                ++replicated;
+            }, 16))
+                std::this_thread::yield();
+    }
+    ));
+
+    threadvec.push_back(std::thread(
+    [&]{
+        std::size_t expected = 0;
+        while (expected != MULTITEST_PUSHCOUNT)
+            if (!bq.consume(metrics, [&](std::size_t v){
+                TEST_ASSERT(v == expected++);
+                TEST_ASSERT(journaled.load() > v && replicated.load() > v);
+            }))
+                std::this_thread::yield();
+    }
+    ));
+
+    for (std::size_t idx = 0; idx < MULTITEST_PUSHCOUNT; ++idx)
+        bq.push_back(idx);
+
+    for(auto& t: threadvec)
+        t.join();
+
+    std::cout<<"\n --- All threads joined ---\n";
+
+    TEST_ASSERT(journaled.load() == MULTITEST_PUSHCOUNT);
+    TEST_ASSERT(replicated.load() == MULTITEST_PUSHCOUNT);
+
+    return CONCLUDE_TEST();
+}
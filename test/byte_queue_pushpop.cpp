@@ -0,0 +1,176 @@
+#include "byte_queue.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include "testutils.hpp"
+
+DECLARE_TEST("byte_queue Push/Pop operations")
+
+
+#ifndef MULTITEST_THREADCOUNT
+#    define MULTITEST_THREADCOUNT 8
+#endif
+
+#ifndef MULTITEST_PUSHCOUNT
+#    define MULTITEST_PUSHCOUNT 4096
+#endif
+
+// Records written by the producer threads: id, index and a payload of
+// variable length filled with a pattern.
+struct record_head {
+    unsigned id_;
+    unsigned idx_;
+};
+
+static std::size_t payload_size(unsigned idx)
+{
+    return (idx * 7) % 61;
+}
+
+static char payload_byte(unsigned id, unsigned idx, std::size_t i)
+{
+    return static_cast<char>(id * 31 + idx + i);
+}
+
+static void write_record(char* p, unsigned id, unsigned idx)
+{
+    record_head h = { id, idx };
+    std::memcpy(p, &h, sizeof(h));
+    for (std::size_t i = 0; i < payload_size(idx); ++i)
+        p[sizeof(h) + i] = payload_byte(id, idx, i);
+}
+
+static bool check_record(const char* p, std::size_t size, record_head& h)
+{
+    std::memcpy(&h, p, sizeof(h));
+    if (size != sizeof(h) + payload_size(h.idx_))
+        return false;
+    for (std::size_t i = 0; i < payload_size(h.idx_); ++i)
+        if (p[sizeof(h) + i] != payload_byte(h.id_, h.idx_, i))
+            return false;
+    return true;
+}
+
+int main()
+{
+    std::cout<<"\n--- Single threaded reserve/commit/read/release ---\n";
+    {
+        aq::byte_queue bq(100);
+        TEST_ASSERT(bq.capacity() == 128);
+        TEST_ASSERT(bq.max_record_size() == 56);
+        TEST_ASSERT(bq.read().data == nullptr);
+        TEST_ASSERT(bq.reserve(57).data == nullptr);
+
+        // nothing is readable before it is committed
+        aq::byte_queue::span a = bq.reserve(5);
+        aq::byte_queue::span b = bq.reserve(20);
+        TEST_ASSERT(a.data && a.size == 5 && b.data && b.size == 20);
+        std::memcpy(a.data, "hello", 5);
+        std::memcpy(b.data, "abcdefghijklmnopqrst", 20);
+        bq.commit(b);
+        TEST_ASSERT(bq.read().data == nullptr);
+        bq.commit(a);
+
+        // 16 + 32 + 64 bytes are used, 16 + 8 more don't fit
+        aq::byte_queue::span c = bq.reserve(56);
+        TEST_ASSERT(c.data && c.size == 56);
+        std::memset(c.data, 'c', 56);
+        bq.commit(c);
+        TEST_ASSERT(bq.reserve(9).data == nullptr);
+
+        aq::byte_queue::const_span r = bq.read();
+        TEST_ASSERT(r.size == 5 && std::memcmp(r.data, "hello", 5) == 0);
+        TEST_ASSERT(bq.read().data == r.data);
+        bq.release(r);
+
+        r = bq.read();
+        TEST_ASSERT(r.size == 20);
+        TEST_ASSERT(std::memcmp(r.data, "abcdefghijklmnopqrst", 20) == 0);
+        bq.release(r);
+
+        r = bq.read();
+        TEST_ASSERT(r.size == 56 && r.data[0] == 'c' && r.data[55] == 'c');
+        bq.release(r);
+        TEST_ASSERT(bq.read().data == nullptr);
+
+        // records of all sizes, wrapping around many times
+        for (unsigned idx = 0; idx < 1000; ++idx)
+        {
+            std::size_t n = idx % (bq.max_record_size() + 1);
+            aq::byte_queue::span w = bq.reserve(n);
+            TEST_ASSERT(w.data && w.size == n);
+            std::memset(w.data, static_cast<char>(idx), n);
+            bq.commit(w);
+
+            r = bq.read();
+            TEST_ASSERT(r.data && r.size == n);
+            for (std::size_t i = 0; i < n; ++i)
+                TEST_ASSERT(r.data[i] == static_cast<char>(idx));
+            bq.release(r);
+        }
+        TEST_ASSERT(bq.read().data == nullptr);
+
+        // sizes beyond 2 GiB don't fit into the record headers
+        bool thrown = false;
+        try {
+            aq::byte_queue huge(std::size_t(-1));
+        } catch(std::length_error&)
+        {
+            thrown = true;
+        }
+        TEST_ASSERT(thrown);
+    }
+
+    std::cout<<"\n--- Launching threads for simultanous reserve ---\n";
+    aq::byte_queue bq(4096);
+    std::vector<std::thread> threadvec;
+
+    for(unsigned ti = 0; ti < MULTITEST_THREADCOUNT; ++ti)
+        threadvec.push_back(std::thread(
+        [&bq, ti]{
+            for(unsigned oi = 0; oi < MULTITEST_PUSHCOUNT; ++oi)
+            {
+                std::size_t n = sizeof(record_head) + payload_size(oi);
+                aq::byte_queue::span s;
+                while (!(s = bq.reserve(n)).data)
+                    std::this_thread::yield();
+
+                write_record(s.data, ti, oi);
+                bq.commit(s);
+            }
+            std::cout<<'#';
+        }
+        ));
+
+    std::vector<unsigned> next_idx(MULTITEST_THREADCOUNT, 0);
+    std::size_t popcount = 0;
+    while (popcount != MULTITEST_PUSHCOUNT * MULTITEST_THREADCOUNT)
+    {
+        aq::byte_queue::const_span r = bq.read();
+        if (!r.data)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        record_head h;
+        TEST_ASSERT(check_record(r.data, r.size, h));
+        TEST_ASSERT(h.id_ < MULTITEST_THREADCOUNT);
+        TEST_ASSERT(next_idx[h.id_]++ == h.idx_);
+        bq.release(r);
+        ++popcount;
+    }
+
+    for(auto& t: threadvec)
+        t.join();
+
+    std::cout<<"\n --- All threads joined ---\n";
+
+    TEST_ASSERT(bq.read().data == nullptr);
+
+    return CONCLUDE_TEST();
+}
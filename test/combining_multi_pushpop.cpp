@@ -0,0 +1,131 @@
+#include "combining_queue.hpp"
+
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include "testutils.hpp"
+
+DECLARE_TEST("combining_queue multithreaded Push/Pop operations")
+
+
+#ifndef MULTITEST_THREADCOUNT
+#    define MULTITEST_THREADCOUNT 64
+#endif
+
+#ifndef MULTITEST_PUSHCOUNT
+#    define MULTITEST_PUSHCOUNT 256
+#endif
+
+struct Obj {
+    int id_;
+    std::size_t idx_;
+    int data_;
+    bool will_throw_;
+
+    Obj()
+        : id_(0), idx_(0), data_(0), will_throw_(false)
+    { }
+
+    Obj(int id, std::size_t idx, bool will_throw = false)
+        : id_(id), idx_(idx), data_(calculate_data(id_, idx_)),
+        will_throw_(will_throw)
+    { }
+
+    Obj(const Obj& other)
+        : id_(other.id_), idx_(other.idx_), data_(other.data_),
+        will_throw_(false)
+    { if(other.will_throw_) throw other.will_throw_; }
+
+    Obj& operator=(const Obj& other)
+    {
+        id_ = other.id_; idx_ = other.idx_; data_ = other.data_;
+        return *this;
+    }
+
+    static int calculate_data(int id, std::size_t idx)
+    {
+        return id ^ idx;
+    }
+};
+
+
+int main()
+{
+    std::vector<std::thread> threadvec;
+    aq::combining_queue<Obj> queue(16);
+    Obj o;
+
+    std::cout<<"\n--- Exceptions are passed to the pushing thread ---\n";
+    queue.push_back(Obj(1, 1));
+    try {
+        const Obj throwing(2, 2, true);
+        queue.push_back(throwing);
+        TEST_ASSERT(false);
+    }
+    catch(bool)
+    {
+        std::cout<<"Caught exception. Hope everyone is still ok!\n";
+    }
+    TEST_ASSERT(queue.size() == 1);
+    TEST_ASSERT(queue.pop_front(o) && o.idx_ == 1);
+    TEST_ASSERT(!queue.pop_front(o));
+
+    std::cout<<"\n--- Launching threads for simultanous push ---\n";
+    for(unsigned ti = 0; ti < MULTITEST_THREADCOUNT; ++ti)
+        threadvec.push_back(std::thread(
+        [&queue, ti]{
+            for(unsigned oi = 0; oi < MULTITEST_PUSHCOUNT; ++oi)
+                queue.push_back(Obj(ti, oi));
+            std::cout<<'#';
+        }
+        ));
+
+    for(auto& t: threadvec)
+        t.join();
+    std::cout<<std::endl;
+
+    TEST_ASSERT(queue.size() ==  MULTITEST_PUSHCOUNT * MULTITEST_THREADCOUNT);
+
+    std::cout<<"\n--- Checking queue objects after calculation ---\n";
+    std::vector<std::size_t> next_idx(MULTITEST_THREADCOUNT, 0);
+    while (queue.pop_front(o))
+    {
+        TEST_ASSERT(o.data_ == Obj::calculate_data(o.id_, o.idx_));
+        TEST_ASSERT(next_idx[o.id_]++ == o.idx_);
+    }
+
+    threadvec.clear();
+
+    std::cout<<"\n--- Launching threads for simultanous push and pop ---\n";
+    std::atomic<std::size_t> popcount(0);
+    for(unsigned ti = 0; ti < MULTITEST_THREADCOUNT; ++ti)
+        threadvec.push_back(std::thread(
+        [&queue, &popcount, ti]{
+            Obj p;
+            for(unsigned oi = 0; oi < MULTITEST_PUSHCOUNT; ++oi)
+            {
+                queue.push_back(Obj(ti, oi));
+                if (queue.pop_front(p))
+                {
+                    TEST_ASSERT(p.data_ == Obj::calculate_data(p.id_, p.idx_));
+                    ++popcount;
+                }
+            }
+            std::cout<<'#';
+        }
+        ));
+
+    for(auto& t: threadvec)
+        t.join();
+
+    while (queue.pop_front(o))
+        ++popcount;
+
+    std::cout<<"\n --- All threads joined ---\n";
+
+    TEST_ASSERT(popcount.load() == MULTITEST_PUSHCOUNT * MULTITEST_THREADCOUNT);
+    TEST_ASSERT(queue.size() == 0);
+
+    return CONCLUDE_TEST();
+}
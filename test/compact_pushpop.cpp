@@ -0,0 +1,118 @@
+#include "compact_queue.hpp"
+
+#include <new>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include "testutils.hpp"
+
+DECLARE_TEST("compact_queue Push/Pop operations")
+
+
+#ifndef MULTITEST_THREADCOUNT
+#    define MULTITEST_THREADCOUNT 8
+#endif
+
+#ifndef MULTITEST_PUSHCOUNT
+#    define MULTITEST_PUSHCOUNT 100000
+#endif
+
+#ifndef MULTITEST_CAPACITY
+#    define MULTITEST_CAPACITY 64
+#endif
+
+struct Obj {
+    unsigned id_;
+    unsigned idx_;
+};
+
+
+int main()
+{
+    std::cout<<"\n--- Single threaded push and pop ---\n";
+    {
+        aq::compact_queue<int> cq(4);
+        TEST_ASSERT(cq.capacity() == 4);
+        TEST_ASSERT(aq::compact_queue<int>::node_size() <= 16);
+
+        int i = -1;
+        TEST_ASSERT(!cq.pop_front(i) && i == -1);
+
+        // the slab is reused over and over again
+        for (int round = 0; round < 10; ++round)
+        {
+            for (int v = 0; v < 4; ++v)
+                cq.push_back(round * 4 + v);
+            TEST_ASSERT(cq.size() == 4);
+            TEST_ASSERT(!cq.try_push_back(-1));
+
+            bool thrown = false;
+            try {
+                cq.push_back(-1);
+            } catch(std::bad_alloc&)
+            {
+                thrown = true;
+            }
+            TEST_ASSERT(thrown);
+
+            for (int v = 0; v < 4; ++v)
+                TEST_ASSERT(cq.pop_front(i) && i == round * 4 + v);
+            TEST_ASSERT(!cq.pop_front(i));
+            TEST_ASSERT(cq.size() == 0);
+        }
+    }
+
+    std::cout<<"\n--- Launching threads for simultanous push and pop ---\n";
+    aq::compact_queue<Obj> cq(MULTITEST_CAPACITY);
+    std::vector<std::thread> threadvec;
+    std::atomic<std::size_t> popcount(0);
+
+    for(unsigned ti = 0; ti < MULTITEST_THREADCOUNT; ++ti)
+        threadvec.push_back(std::thread(
+        [&cq, ti]{
+            for(unsigned oi = 0; oi < MULTITEST_PUSHCOUNT; ++oi)
+            {
+                Obj o = { ti, oi };
+                while (!cq.try_push_back(o))
+                    std::this_thread::yield();
+            }
+            std::cout<<'#';
+        }
+        ));
+
+    for(unsigned ti = 0; ti < MULTITEST_THREADCOUNT; ++ti)
+        threadvec.push_back(std::thread(
+        [&cq, &popcount]{
+            // every popper sees the elements of each pusher in order
+            std::vector<unsigned> next_idx(MULTITEST_THREADCOUNT, 0);
+            Obj o;
+
+            while (popcount.load() != MULTITEST_PUSHCOUNT * MULTITEST_THREADCOUNT)
+            {
+                if (!cq.pop_front(o))
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                TEST_ASSERT(o.id_ < MULTITEST_THREADCOUNT);
+                TEST_ASSERT(o.idx_ >= next_idx[o.id_]);
+                next_idx[o.id_] = o.idx_ + 1;
+                ++popcount;
+            }
+        }
+        ));
+
+    for(auto& t: threadvec)
+        t.join();
+
+    std::cout<<"\n --- All threads joined ---\n";
+
+    Obj o;
+    TEST_ASSERT(!cq.pop_front(o));
+    TEST_ASSERT(cq.size() == 0);
+    TEST_ASSERT(popcount.load() == MULTITEST_PUSHCOUNT * MULTITEST_THREADCOUNT);
+
+    return CONCLUDE_TEST();
+}
@@ -0,0 +1,110 @@
+#include "executor.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include "testutils.hpp"
+
+DECLARE_TEST("executor Submit operations")
+
+
+#ifndef EXECUTORTEST_TASKCOUNT
+#    define EXECUTORTEST_TASKCOUNT 4096
+#endif
+
+// Count every allocation made by the program
+static std::atomic<std::size_t> allocation_counter(0);
+
+void* operator new(std::size_t size)
+{
+    ++allocation_counter;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+// A callable that can only be moved
+struct move_only_task
+{
+    std::unique_ptr<int> ptr_;
+    std::atomic<std::size_t>* done_;
+
+    void operator()() { if (*ptr_ == 42) ++*done_; }
+};
+
+static void wait_for(const std::atomic<std::size_t>& counter, std::size_t n)
+{
+    while (counter.load() != n)
+        std::this_thread::yield();
+}
+
+int main()
+{
+    std::atomic<std::size_t> done(0);
+
+    {
+        aq::executor ex(4, EXECUTORTEST_TASKCOUNT);
+        TEST_ASSERT(ex.concurrency() == 4);
+
+        std::cout<<"\n--- Submitting small tasks ---\n";
+        std::size_t allocations = allocation_counter.load();
+        for (std::size_t i = 0; i < EXECUTORTEST_TASKCOUNT; ++i)
+            ex.submit([&done]{ ++done; });
+        wait_for(done, EXECUTORTEST_TASKCOUNT);
+
+        TEST_ASSERT(allocation_counter.load() == allocations);
+
+        std::cout<<"\n--- Submitting move-only and oversized tasks ---\n";
+        done = 0;
+        move_only_task mo = { std::unique_ptr<int>(new int(42)), &done };
+        TEST_ASSERT(aq::executor::task_type::stores_inline<move_only_task>::value);
+        ex.submit(std::move(mo));
+
+        struct big { char data[256]; } b;
+        b.data[255] = 7;
+        TEST_ASSERT(!aq::executor::task_type::stores_inline<big>::value);
+        ex.submit([&done, b]{ if (b.data[255] == 7) ++done; });
+        wait_for(done, 2);
+
+        std::cout<<"\n--- Submitting tasks in bulk ---\n";
+        done = 0;
+        std::vector<aq::executor::task_type> tasks;
+        for (std::size_t i = 0; i < EXECUTORTEST_TASKCOUNT; ++i)
+            tasks.push_back(aq::executor::task_type([&done]{ ++done; }));
+        ex.submit_bulk(tasks.begin(), tasks.end());
+        wait_for(done, EXECUTORTEST_TASKCOUNT);
+
+        std::cout<<"\n--- Filling up the ring, destructing the executor ---\n";
+        done = 0;
+    }
+
+    {
+        aq::executor ex(2, 4, 2);
+
+        std::vector<std::thread> threadvec;
+        for (unsigned ti = 0; ti < 4; ++ti)
+            threadvec.push_back(std::thread(
+            [&ex, &done]{
+                for (std::size_t i = 0; i < EXECUTORTEST_TASKCOUNT; ++i)
+                    ex.submit([&done]{ ++done; });
+            }
+            ));
+
+        for (auto& t: threadvec)
+            t.join();
+    }
+
+    TEST_ASSERT(done.load() == 4 * EXECUTORTEST_TASKCOUNT);
+
+    return CONCLUDE_TEST();
+}
@@ -0,0 +1,126 @@
+/*
+* Copyright (c) 2012 Alexander Korsunsky <fat.lobyte9@gmail.com>
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*
+* 1. Redistributions of source code must retain the above copyright notice,
+* this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+* IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+* THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+* PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+* CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+* OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+* OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef THREAD_INDEX_HPP_INCLUDED
+#define THREAD_INDEX_HPP_INCLUDED
+
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace aq {
+
+namespace detail {
+
+/** Hands out thread indices and takes them back when their threads exit. */
+class thread_index_registry
+{
+public:
+    thread_index_registry() noexcept
+        : next_(0)
+    { }
+
+    /** Get the smallest index that no live thread holds. */
+    std::size_t acquire()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (free_.empty())
+        {
+            // make sure release() never has to allocate
+            free_.reserve(next_ + 1);
+            return next_++;
+        }
+
+        std::pop_heap(free_.begin(), free_.end(), std::greater<std::size_t>());
+        std::size_t index = free_.back();
+        free_.pop_back();
+        return index;
+    }
+
+    /** Give back an index obtained from acquire(). */
+    void release(std::size_t index) noexcept
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        free_.push_back(index);
+        std::push_heap(free_.begin(), free_.end(), std::greater<std::size_t>());
+    }
+
+private:
+    std::mutex mutex_ /**< Protects the members below. */;
+    std::vector<std::size_t> free_ /**< Released indices, a min-heap. */;
+    std::size_t next_ /**< Smallest index never handed out. */;
+};
+
+/** Holds the index of one thread and releases it when the thread exits. */
+class thread_index_holder
+{
+public:
+    explicit thread_index_holder(thread_index_registry& registry)
+        : registry_(registry), index_(registry.acquire())
+    { }
+
+    ~thread_index_holder() noexcept
+    { registry_.release(index_); }
+
+    std::size_t index() const noexcept
+    { return index_; }
+
+private:
+    thread_index_holder(const thread_index_holder&);
+    thread_index_holder& operator=(const thread_index_holder&);
+
+    thread_index_registry& registry_;
+    std::size_t index_;
+};
+
+/** A small number that is different for every live thread of the process.
+*
+* A thread gets the smallest number that no other live thread holds, and
+* gives it back when it exits. So the numbers stay below the largest number
+* of threads that have been alive at the same time, even in processes that
+* start and retire many threads, and can be used to pick per-thread slots
+* from an array.
+*/
+inline std::size_t this_thread_index() noexcept
+{
+    // constructed before the holder of any thread, so it outlives all of them
+    static thread_index_registry registry;
+    static thread_local thread_index_holder holder(registry);
+    return holder.index();
+}
+
+} // namespace detail
+
+} // namespace aq
+
+#endif // ifndef THREAD_INDEX_HPP_INCLUDED